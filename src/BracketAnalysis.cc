@@ -0,0 +1,328 @@
+/*
+ *      BracketAnalysis.cc
+ *
+ *      Copyright 2023 Asif Amin <asifamin@utexas.edu>
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+
+/* --------------------------------- INCLUDES ------------------------------- */
+
+#include "BracketAnalysis.h"
+#include "BracketScanner.h"
+#include "Metrics.h"
+
+/* ------------------------------ IMPLEMENTATION ---------------------------- */
+
+
+// -----------------------------------------------------------------------------
+    BracketAnalysis::BracketAnalysis()
+/*
+    Constructor
+----------------------------------------------------------------------------- */
+:   mGeneration(0),
+    mParallelMinSize(G_MAXINT)
+{
+    for (guint i = 0; i < BracketType::COUNT; i++) {
+        mEnabled[i] = FALSE;
+    }
+}
+
+
+
+// -----------------------------------------------------------------------------
+    void BracketAnalysis::Capture(
+        ScintillaObject *sci,
+        guint64 generation,
+        const CodeStyleSet &codeStyles,
+        const gboolean enabled[BracketType::COUNT]
+    )
+/*
+    snapshot everything Run() needs, must be called on the main thread
+----------------------------------------------------------------------------- */
+{
+    BracketScanner scanner(sci);
+    BC_METRICS_COUNT_MESSAGE(SCI_GETLENGTH);
+    gint length = scintilla_send_message(sci, SCI_GETLENGTH, 0, 0);
+
+    mGeneration = generation;
+    mCodeStyles = codeStyles;
+    for (guint i = 0; i < BracketType::COUNT; i++) {
+        mEnabled[i] = enabled[i];
+    }
+
+    mText.clear();
+    mText.reserve(length);
+    scanner.ForEachSlice(0, length,
+        [&](const gchar *text, gint /*position*/, gint sliceLength) {
+            mText.append(text, sliceLength);
+        }
+    );
+
+    scanner.GetStyles(0, length, mStyles);
+}
+
+
+
+// -----------------------------------------------------------------------------
+    struct ParallelBatch {
+
+        /*
+         * Jobs of one parallel_for() call, the caller waits on done until
+         * remaining drops to zero
+         */
+
+        void (*run)(gpointer callback, guint index);
+        gpointer callback;
+
+        GMutex mutex;
+        GCond done;
+        guint remaining;
+    };
+
+    struct ParallelJob {
+        ParallelBatch *batch;
+        guint index;
+    };
+
+
+
+// -----------------------------------------------------------------------------
+    static void parallel_job_finish(ParallelBatch *batch)
+/*
+
+----------------------------------------------------------------------------- */
+{
+    g_mutex_lock(&batch->mutex);
+    if (--batch->remaining == 0) {
+        g_cond_signal(&batch->done);
+    }
+    g_mutex_unlock(&batch->mutex);
+}
+
+
+
+// -----------------------------------------------------------------------------
+    static void parallel_job_run(gpointer data, gpointer /*userData*/)
+/*
+    worker function of the shared pool
+----------------------------------------------------------------------------- */
+{
+    ParallelJob *job = reinterpret_cast<ParallelJob *>(data);
+    job->batch->run(job->batch->callback, job->index);
+    parallel_job_finish(job->batch);
+}
+
+
+
+// -----------------------------------------------------------------------------
+    static GThreadPool *get_parallel_pool(void)
+/*
+    one pool for every analysis, its threads are kept between analyses
+    instead of being created for each one. NULL if it could not be made.
+----------------------------------------------------------------------------- */
+{
+    static GThreadPool *pool = NULL;
+
+    if (g_once_init_enter(&pool)) {
+        GThreadPool *newPool = g_thread_pool_new(
+            parallel_job_run, NULL, g_get_num_processors(), FALSE, NULL
+        );
+        g_once_init_leave(&pool, newPool);
+    }
+
+    return pool;
+}
+
+
+
+// -----------------------------------------------------------------------------
+    template<typename Callback>
+    static void parallel_job_call(gpointer callback, guint index)
+/*
+
+----------------------------------------------------------------------------- */
+{
+    (*reinterpret_cast<Callback *>(callback))(index);
+}
+
+
+
+// -----------------------------------------------------------------------------
+    template<typename Callback>
+    static void parallel_for(guint count, Callback callback)
+/*
+    callback(i) for i in [0, count) on the shared pool. The calling thread
+    takes the first one, and any job the pool could not take.
+----------------------------------------------------------------------------- */
+{
+    ParallelBatch batch;
+    batch.run = parallel_job_call<Callback>;
+    batch.callback = &callback;
+    batch.remaining = count;
+    g_mutex_init(&batch.mutex);
+    g_cond_init(&batch.done);
+
+    std::vector<ParallelJob> jobs;
+    for (guint i = 0; i < count; i++) {
+        jobs.push_back({ &batch, i });
+    }
+
+    GThreadPool *pool = get_parallel_pool();
+    for (guint i = 1; i < count; i++) {
+        if (pool == NULL or not g_thread_pool_push(pool, &jobs[i], NULL)) {
+            parallel_job_run(&jobs[i], NULL);
+        }
+    }
+
+    parallel_job_run(&jobs[0], NULL);
+
+    g_mutex_lock(&batch.mutex);
+    while (batch.remaining > 0) {
+        g_cond_wait(&batch.done, &batch.mutex);
+    }
+    g_mutex_unlock(&batch.mutex);
+
+    g_mutex_clear(&batch.mutex);
+    g_cond_clear(&batch.done);
+}
+
+
+
+// -----------------------------------------------------------------------------
+    void BracketAnalysis::MatchRange(
+        gint start, gint end,
+        BracketMatcher &matcher
+    ) const
+/*
+    pair the brackets of [start, end) of the snapshot
+----------------------------------------------------------------------------- */
+{
+    std::vector<BracketHit> hits;
+    std::vector<BracketMatcher::StyledBracket> brackets;
+
+    for (gint position = start; position < end; position += BracketScanner::BLOCK_SIZE) {
+
+        gint blockLength = std::min(end - position, BracketScanner::BLOCK_SIZE);
+
+        hits.clear();
+        bracket_scan_block(mText.data() + position, blockLength, position, hits);
+
+        for (const BracketHit &hit : hits) {
+            BracketType type = bracket_class_type(hit.bracketClass);
+            if (mEnabled[type] == TRUE) {
+                brackets.push_back(
+                    { hit.position, hit.bracketClass, mStyles[hit.position] }
+                );
+            }
+        }
+    }
+
+    matcher.Run(brackets, mCodeStyles, mEnabled);
+}
+
+
+
+// -----------------------------------------------------------------------------
+    void BracketAnalysis::BuildMap(
+        const BracketMatcher &matcher
+    )
+/*
+    merge the matches of every type into the map and compute nesting orders
+----------------------------------------------------------------------------- */
+{
+    std::vector<BracketMap::Entry> assigned;
+    std::vector<BracketMap::Index> updatedBrackets;
+
+    gsize heads[BracketType::COUNT] = { 0 };
+    gsize numMatches = 0;
+    for (gint bracketType = 0; bracketType < BracketType::COUNT; bracketType++) {
+        numMatches += matcher.mMatches[bracketType].size();
+    }
+    assigned.reserve(numMatches);
+
+    // each type is already sorted, keep taking the lowest head
+    while (assigned.size() < numMatches) {
+
+        gint next = -1;
+        for (gint bracketType = 0; bracketType < BracketType::COUNT; bracketType++) {
+            const auto &matches = matcher.mMatches[bracketType];
+            if (
+                heads[bracketType] < matches.size() and (
+                    next < 0 or
+                    matches[heads[bracketType]].position <
+                        matcher.mMatches[next][heads[next]].position
+                )
+            ) {
+                next = bracketType;
+            }
+        }
+
+        const auto &match = matcher.mMatches[next][heads[next]++];
+        assigned.push_back(
+            { match.position, match.length, static_cast<BracketMap::Type>(next) }
+        );
+    }
+
+    mBracketMap.Assign(assigned);
+    mBracketMap.ComputeOrder(updatedBrackets);
+}
+
+
+
+// -----------------------------------------------------------------------------
+    void BracketAnalysis::Run()
+/*
+    pair every bracket and compute nesting orders, safe to call from any
+    thread since only the snapshot is read
+----------------------------------------------------------------------------- */
+{
+    gint length = mText.size();
+    guint numThreads = g_get_num_processors();
+
+    BracketMatcher matcher;
+
+    if (numThreads < 2 or length < mParallelMinSize) {
+        MatchRange(0, length, matcher);
+    }
+    else {
+        std::vector<BracketMatcher> chunks(numThreads);
+        gint chunkSize = length / numThreads + 1;
+
+        parallel_for(numThreads,
+            [&](guint chunk) {
+                gint start = std::min<gint>(chunk * chunkSize, length);
+                gint end = std::min(start + chunkSize, length);
+                MatchRange(start, end, chunks[chunk]);
+            }
+        );
+
+        matcher.Combine(chunks);
+    }
+
+    BuildMap(matcher);
+}
+
+
+
+// -----------------------------------------------------------------------------
+    gsize BracketAnalysis::MemoryUsage() const
+/*
+    heap bytes held by the snapshot and the map built from it
+----------------------------------------------------------------------------- */
+{
+    return mText.capacity() + mStyles.capacity() + mBracketMap.MemoryUsage();
+}
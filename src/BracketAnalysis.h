@@ -0,0 +1,80 @@
+/*
+ *      BracketAnalysis.h
+ *
+ *      Copyright 2023 Asif Amin <asifamin@utexas.edu>
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+#ifndef __BRACKET_ANALYSIS_H__
+#define __BRACKET_ANALYSIS_H__
+
+/* --------------------------------- INCLUDES ------------------------------- */
+
+#include <string>
+#include <vector>
+
+#include <geanyplugin.h>
+
+#include "BracketClassifier.h"
+#include "BracketMap.h"
+#include "BracketMatcher.h"
+
+/* ----------------------------- CLASS DEFINITIONS -------------------------- */
+
+// -----------------------------------------------------------------------------
+    struct BracketAnalysis
+/*
+    Purpose:    full bracket analysis of a copy of the document
+
+    Capture() copies text and style bytes on the main thread. Run() only
+    touches the copy, so it can be done on a worker thread while the user
+    keeps typing. The resulting map is handed over with BracketMap::Swap()
+    if mGeneration still matches the document.
+
+    Documents of at least mParallelMinSize bytes are split into one chunk
+    per processor. Chunks are matched on a shared thread pool and joined with
+    BracketMatcher::Combine() before the map and nesting orders are built.
+----------------------------------------------------------------------------- */
+{
+    guint64 mGeneration;
+
+    std::string mText;
+    std::vector<guint8> mStyles;
+    CodeStyleSet mCodeStyles;
+    gboolean mEnabled[BracketType::COUNT];
+    gint mParallelMinSize;
+
+    BracketMap mBracketMap;
+
+    BracketAnalysis();
+
+    void Capture(
+        ScintillaObject *sci,
+        guint64 generation,
+        const CodeStyleSet &codeStyles,
+        const gboolean enabled[BracketType::COUNT]
+    );
+
+    void Run();
+
+    gsize MemoryUsage() const;
+
+private:
+    void MatchRange(gint start, gint end, BracketMatcher &matcher) const;
+    void BuildMap(const BracketMatcher &matcher);
+};
+
+#endif
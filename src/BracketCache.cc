@@ -0,0 +1,258 @@
+/*
+ *      BracketCache.cc
+ *
+ *      Copyright 2023 Asif Amin <asifamin@utexas.edu>
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+/* --------------------------------- INCLUDES ------------------------------- */
+
+#include <string.h>
+#include <algorithm>
+#include <utility>
+
+#include <geanyplugin.h>
+#include <glib/gstdio.h>
+
+#include "BracketCache.h"
+
+/* -------------------------------- DEFINITIONS ----------------------------- */
+
+    // written in host byte order, files from another machine just miss
+    struct CacheHeader {
+        guint32 magic;
+        guint32 version;
+        guint64 hash;
+        gint32 lexer;
+        gint32 length;
+        guint32 enabledTypes;
+        guint32 blobSize;
+    };
+
+    static const guint32 sCacheMagic = 0x58494342;   // "BCIX"
+    static const guint32 sCacheVersion = 1;
+
+/* ------------------------------ IMPLEMENTATION ---------------------------- */
+
+
+// -----------------------------------------------------------------------------
+    BracketCache::BracketCache(
+        std::string directory
+    )
+/*
+    Constructor
+----------------------------------------------------------------------------- */
+:   mDirectory(directory)
+{
+    // nothing to do
+}
+
+
+
+// -----------------------------------------------------------------------------
+    guint64 BracketCache::HashContent(
+        const gchar *text,
+        gsize length
+    )
+/*
+    hash of a whole document, eight bytes at a time. Only has to tell
+    versions of the same file apart, not resist attacks.
+----------------------------------------------------------------------------- */
+{
+    const guint64 prime1 = G_GUINT64_CONSTANT(0x9E3779B185EBCA87);
+    const guint64 prime2 = G_GUINT64_CONSTANT(0xC2B2AE3D27D4EB4F);
+
+    guint64 hash = length * prime1;
+
+    gsize i = 0;
+    for (; i + sizeof(guint64) <= length; i += sizeof(guint64)) {
+        guint64 word;
+        memcpy(&word, text + i, sizeof(word));
+        hash ^= word * prime2;
+        hash = ((hash << 31) | (hash >> 33)) * prime1;
+    }
+
+    for (; i < length; i++) {
+        hash ^= guint8(text[i]) * prime1;
+        hash = ((hash << 11) | (hash >> 53)) * prime2;
+    }
+
+    hash ^= hash >> 33;
+    hash *= prime2;
+    hash ^= hash >> 29;
+
+    return hash;
+}
+
+
+
+// -----------------------------------------------------------------------------
+    std::string BracketCache::GetFilename(
+        const Key &key
+    ) const
+/*
+
+----------------------------------------------------------------------------- */
+{
+    gchar *name = g_strdup_printf(
+        "%016" G_GINT64_MODIFIER "x-%d.bcidx", key.hash, key.lexer
+    );
+    gchar *path = g_build_filename(mDirectory.c_str(), name, NULL);
+
+    std::string filename(path);
+
+    g_free(path);
+    g_free(name);
+
+    return filename;
+}
+
+
+
+// -----------------------------------------------------------------------------
+    gboolean BracketCache::Load(
+        const Key &key,
+        BracketMap &bracketMap
+    ) const
+/*
+    decode the cached map for key straight from the mapped file, FALSE if
+    there is none or it does not match
+----------------------------------------------------------------------------- */
+{
+    std::string filename = GetFilename(key);
+
+    GMappedFile *file = g_mapped_file_new(filename.c_str(), FALSE, NULL);
+    if (file == NULL) {
+        return FALSE;
+    }
+
+    const guint8 *contents = reinterpret_cast<const guint8 *>(
+        g_mapped_file_get_contents(file)
+    );
+    gsize size = g_mapped_file_get_length(file);
+
+    CacheHeader header;
+    gboolean found = FALSE;
+
+    if (size >= sizeof(header)) {
+        memcpy(&header, contents, sizeof(header));
+
+        found =
+            header.magic == sCacheMagic and
+            header.version == sCacheVersion and
+            header.hash == key.hash and
+            header.lexer == key.lexer and
+            header.length == key.length and
+            header.enabledTypes == key.enabledTypes and
+            header.blobSize == size - sizeof(header) and
+            bracketMap.Decode(contents + sizeof(header), header.blobSize, key.length);
+    }
+
+    g_mapped_file_unref(file);
+
+    return found;
+}
+
+
+
+// -----------------------------------------------------------------------------
+    gboolean BracketCache::Store(
+        const Key &key,
+        const std::vector<guint8> &blob
+    ) const
+/*
+    write blob for key, replacing the file atomically
+----------------------------------------------------------------------------- */
+{
+    gint err = utils_mkdir(mDirectory.c_str(), TRUE);
+    if (err != 0) {
+        g_warning(
+            "Failed to create cache directory \"%s\": %s",
+            mDirectory.c_str(), g_strerror(err)
+        );
+        return FALSE;
+    }
+
+    CacheHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = sCacheMagic;
+    header.version = sCacheVersion;
+    header.hash = key.hash;
+    header.lexer = key.lexer;
+    header.length = key.length;
+    header.enabledTypes = key.enabledTypes;
+    header.blobSize = blob.size();
+
+    std::string contents(reinterpret_cast<const gchar *>(&header), sizeof(header));
+    contents.append(reinterpret_cast<const gchar *>(blob.data()), blob.size());
+
+    std::string filename = GetFilename(key);
+
+    GError *error = NULL;
+    if (!g_file_set_contents(filename.c_str(), contents.data(), contents.size(), &error)) {
+        g_warning("Failed to write bracket cache: %s", error->message);
+        g_error_free(error);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+
+
+// -----------------------------------------------------------------------------
+    void BracketCache::Prune(
+        guint maxFiles
+    ) const
+/*
+    keep only the maxFiles most recently written cache files
+----------------------------------------------------------------------------- */
+{
+    GDir *dir = g_dir_open(mDirectory.c_str(), 0, NULL);
+    if (dir == NULL) {
+        return;
+    }
+
+    std::vector<std::pair<gint64, std::string> > files;
+
+    const gchar *name;
+    while ((name = g_dir_read_name(dir)) != NULL) {
+        if (not g_str_has_suffix(name, ".bcidx")) {
+            continue;
+        }
+
+        gchar *path = g_build_filename(mDirectory.c_str(), name, NULL);
+
+        GStatBuf st;
+        if (g_stat(path, &st) == 0) {
+            files.push_back(std::make_pair(gint64(st.st_mtime), std::string(path)));
+        }
+
+        g_free(path);
+    }
+
+    g_dir_close(dir);
+
+    if (files.size() <= maxFiles) {
+        return;
+    }
+
+    std::sort(files.begin(), files.end());
+
+    for (gsize i = 0; i < files.size() - maxFiles; i++) {
+        g_unlink(files[i].second.c_str());
+    }
+}
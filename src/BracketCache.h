@@ -0,0 +1,68 @@
+/*
+ *      BracketCache.h
+ *
+ *      Copyright 2023 Asif Amin <asifamin@utexas.edu>
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+#ifndef __BRACKET_CACHE_H__
+#define __BRACKET_CACHE_H__
+
+/* --------------------------------- INCLUDES ------------------------------- */
+
+#include <string>
+#include <vector>
+
+#include <glib.h>
+
+#include "BracketMap.h"
+
+/* ----------------------------- CLASS DEFINITIONS -------------------------- */
+
+// -----------------------------------------------------------------------------
+    struct BracketCache
+/*
+    Purpose:    bracket maps of unchanged files kept on disk between sessions
+
+    Every file holds a fixed header followed by the blob written by
+    BracketMap::Encode(). Files are named after the content hash and lexer
+    they were computed for, and are memory mapped and decoded in place when
+    a document with the same key is opened.
+----------------------------------------------------------------------------- */
+{
+    // what a cached bracket map was computed from
+    struct Key {
+        guint64 hash;
+        gint lexer;
+        gint length;
+        guint32 enabledTypes;
+    };
+
+    std::string mDirectory;
+
+    BracketCache(std::string directory);
+
+    gboolean Load(const Key &key, BracketMap &bracketMap) const;
+    gboolean Store(const Key &key, const std::vector<guint8> &blob) const;
+    void Prune(guint maxFiles) const;
+
+    static guint64 HashContent(const gchar *text, gsize length);
+
+private:
+    std::string GetFilename(const Key &key) const;
+};
+
+#endif
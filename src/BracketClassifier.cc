@@ -0,0 +1,212 @@
+/*
+ *      BracketClassifier.cc
+ *
+ *      Copyright 2023 Asif Amin <asifamin@utexas.edu>
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+
+/* --------------------------------- INCLUDES ------------------------------- */
+
+#include "BracketClassifier.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+# define BC_HAVE_X86_KERNELS 1
+# include <immintrin.h>
+#endif
+
+/* ----------------------------------- TYPES -------------------------------- */
+
+    typedef void (*ScanKernel)(
+        const gchar *text, gsize length,
+        gint position,
+        std::vector<BracketHit> &hits
+    );
+
+    struct ScanKernelInfo {
+        ScanKernel kernel;
+        const gchar *name;
+    };
+
+/* ------------------------------ IMPLEMENTATION ---------------------------- */
+
+
+// -----------------------------------------------------------------------------
+    static void scan_block_scalar(
+        const gchar *text, gsize length,
+        gint position,
+        std::vector<BracketHit> &hits
+    )
+/*
+    table driven fallback, also used for the tail of the vector kernels
+----------------------------------------------------------------------------- */
+{
+    for (gsize i = 0; i < length; i++) {
+        guint8 bracketClass = bracket_class(text[i]);
+        if (bracketClass & BC_CLASS_BRACKET) {
+            hits.push_back({ static_cast<gint>(position + i), bracketClass });
+        }
+    }
+}
+
+
+
+#ifdef BC_HAVE_X86_KERNELS
+
+// -----------------------------------------------------------------------------
+    static inline void push_mask_hits(
+        const gchar *text,
+        gint position,
+        guint32 mask,
+        std::vector<BracketHit> &hits
+    )
+/*
+    every set bit in mask is a bracket at text[bit]
+----------------------------------------------------------------------------- */
+{
+    while (mask) {
+        guint bit = __builtin_ctz(mask);
+        hits.push_back({ position + static_cast<gint>(bit), bracket_class(text[bit]) });
+        mask &= mask - 1;
+    }
+}
+
+
+
+// -----------------------------------------------------------------------------
+    __attribute__((target("sse2")))
+    static void scan_block_sse2(
+        const gchar *text, gsize length,
+        gint position,
+        std::vector<BracketHit> &hits
+    )
+/*
+    compare 16 bytes at a time against all eight bracket characters
+----------------------------------------------------------------------------- */
+{
+    const __m128i brackets[] = {
+        _mm_set1_epi8('('), _mm_set1_epi8(')'),
+        _mm_set1_epi8('['), _mm_set1_epi8(']'),
+        _mm_set1_epi8('{'), _mm_set1_epi8('}'),
+        _mm_set1_epi8('<'), _mm_set1_epi8('>')
+    };
+
+    gsize i = 0;
+    for (; i + 16 <= length; i += 16) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(text + i));
+        __m128i matches = _mm_setzero_si128();
+        for (const __m128i &bracket : brackets) {
+            matches = _mm_or_si128(matches, _mm_cmpeq_epi8(block, bracket));
+        }
+
+        guint32 mask = _mm_movemask_epi8(matches);
+        if (mask) {
+            push_mask_hits(text + i, position + i, mask, hits);
+        }
+    }
+
+    scan_block_scalar(text + i, length - i, position + i, hits);
+}
+
+
+
+// -----------------------------------------------------------------------------
+    __attribute__((target("avx2")))
+    static void scan_block_avx2(
+        const gchar *text, gsize length,
+        gint position,
+        std::vector<BracketHit> &hits
+    )
+/*
+    compare 32 bytes at a time against all eight bracket characters
+----------------------------------------------------------------------------- */
+{
+    const __m256i brackets[] = {
+        _mm256_set1_epi8('('), _mm256_set1_epi8(')'),
+        _mm256_set1_epi8('['), _mm256_set1_epi8(']'),
+        _mm256_set1_epi8('{'), _mm256_set1_epi8('}'),
+        _mm256_set1_epi8('<'), _mm256_set1_epi8('>')
+    };
+
+    gsize i = 0;
+    for (; i + 32 <= length; i += 32) {
+        __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(text + i));
+        __m256i matches = _mm256_setzero_si256();
+        for (const __m256i &bracket : brackets) {
+            matches = _mm256_or_si256(matches, _mm256_cmpeq_epi8(block, bracket));
+        }
+
+        guint32 mask = _mm256_movemask_epi8(matches);
+        if (mask) {
+            push_mask_hits(text + i, position + i, mask, hits);
+        }
+    }
+
+    scan_block_sse2(text + i, length - i, position + i, hits);
+}
+
+#endif
+
+
+
+// -----------------------------------------------------------------------------
+    static const ScanKernelInfo& select_kernel(void)
+/*
+    pick the widest kernel this cpu supports, only done once
+----------------------------------------------------------------------------- */
+{
+    static const ScanKernelInfo sKernel = []() -> ScanKernelInfo {
+#ifdef BC_HAVE_X86_KERNELS
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) {
+            return { scan_block_avx2, "avx2" };
+        }
+        if (__builtin_cpu_supports("sse2")) {
+            return { scan_block_sse2, "sse2" };
+        }
+#endif
+        return { scan_block_scalar, "scalar" };
+    }();
+
+    return sKernel;
+}
+
+
+
+// -----------------------------------------------------------------------------
+    void bracket_scan_block(
+        const gchar *text, gsize length,
+        gint position,
+        std::vector<BracketHit> &hits
+    )
+/*
+    append every bracket byte in text to hits, position is the document
+    position of text[0]
+----------------------------------------------------------------------------- */
+{
+    select_kernel().kernel(text, length, position, hits);
+}
+
+
+
+// -----------------------------------------------------------------------------
+    const gchar* bracket_scan_kernel_name(void)
+/*
+
+----------------------------------------------------------------------------- */
+{
+    return select_kernel().name;
+}
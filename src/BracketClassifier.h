@@ -0,0 +1,100 @@
+/*
+ *      BracketClassifier.h
+ *
+ *      Copyright 2023 Asif Amin <asifamin@utexas.edu>
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+#ifndef __BRACKET_CLASSIFIER_H__
+#define __BRACKET_CLASSIFIER_H__
+
+/* --------------------------------- INCLUDES ------------------------------- */
+
+#include <array>
+#include <vector>
+
+#include <glib.h>
+
+/* ----------------------------------- TYPES -------------------------------- */
+
+    enum BracketType {
+        PAREN = 0,
+        BRACE,
+        BRACKET,
+        ANGLE,
+        COUNT
+    };
+
+    // bracket byte found by bracket_scan_block()
+    struct BracketHit {
+        gint position;
+        guint8 bracketClass;
+    };
+
+/* --------------------------------- CONSTANTS ------------------------------ */
+
+    /*
+     * Every byte maps to a class: the low bits hold its BracketType, the
+     * flags below say whether it is a bracket at all and if it opens.
+     */
+
+    static const guint8 BC_CLASS_TYPE_MASK = 0x03;
+    static const guint8 BC_CLASS_OPEN = 0x40;
+    static const guint8 BC_CLASS_BRACKET = 0x80;
+
+    constexpr std::array<guint8, 256> bracket_make_class_table()
+    {
+        std::array<guint8, 256> table {};
+
+        const guchar pairs[BracketType::COUNT][2] = {
+            { '(', ')' },
+            { '[', ']' },
+            { '{', '}' },
+            { '<', '>' }
+        };
+
+        for (guint type = 0; type < BracketType::COUNT; type++) {
+            table[pairs[type][0]] = BC_CLASS_BRACKET | BC_CLASS_OPEN | type;
+            table[pairs[type][1]] = BC_CLASS_BRACKET | type;
+        }
+
+        return table;
+    }
+
+    inline constexpr std::array<guint8, 256> sBracketClassTable = \
+        bracket_make_class_table();
+
+/* --------------------------------- PROTOTYPES ----------------------------- */
+
+    inline guint8 bracket_class(gchar ch)
+    {
+        return sBracketClassTable[static_cast<guchar>(ch)];
+    }
+
+    inline BracketType bracket_class_type(guint8 bracketClass)
+    {
+        return static_cast<BracketType>(bracketClass & BC_CLASS_TYPE_MASK);
+    }
+
+    void bracket_scan_block(
+        const gchar *text, gsize length,
+        gint position,
+        std::vector<BracketHit> &hits
+    );
+
+    const gchar* bracket_scan_kernel_name(void);
+
+#endif
@@ -0,0 +1,186 @@
+/*
+ *      BracketEdits.cc
+ *
+ *      Copyright 2023 Asif Amin <asifamin@utexas.edu>
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+/* --------------------------------- INCLUDES ------------------------------- */
+
+#include <algorithm>
+#include <vector>
+
+#include "BracketEdits.h"
+
+/* ------------------------------ IMPLEMENTATION ---------------------------- */
+
+
+// -----------------------------------------------------------------------------
+    gboolean bracket_edit_insert(
+        BracketMap &bracketMap,
+        DirtyRanges &recomputeRanges,
+        gint position, gint length
+    )
+/*
+    handle when text is added
+----------------------------------------------------------------------------- */
+{
+    gboolean madeChange = FALSE;
+
+    /*
+     * Brackets before the insertion which reach over it may pair up
+     * differently now and need to be recomputed
+     */
+
+    gsize insertIndex = bracketMap.LowerBound(position);
+    std::vector<BracketMap::Index> reaching;
+    bracketMap.Reaching(0, insertIndex, position, reaching);
+    for (BracketMap::Index startPos : reaching) {
+        recomputeRanges.Add(startPos);
+        madeChange = TRUE;
+    }
+
+    // Everything after the insertion just moves, the new text itself is
+    // queued as a whole by the caller
+    if (insertIndex < bracketMap.Size()) {
+        bracketMap.Shift(position, length);
+        madeChange = TRUE;
+    }
+
+    return madeChange;
+}
+
+
+
+// -----------------------------------------------------------------------------
+    gboolean bracket_edit_delete(
+        BracketMap &bracketMap,
+        DirtyRanges &recomputeRanges,
+        gint position, gint length
+    )
+/*
+    handle when text is removed
+----------------------------------------------------------------------------- */
+{
+    gboolean madeChange = FALSE;
+
+    // end bracket removed or space removed
+    gsize removeIndex = bracketMap.LowerBound(position);
+    std::vector<BracketMap::Index> reaching;
+    bracketMap.Reaching(0, removeIndex, position, reaching);
+    for (BracketMap::Index startPos : reaching) {
+        recomputeRanges.Add(startPos);
+        madeChange = TRUE;
+    }
+
+    // start bracket was deleted
+    for (
+        gsize i = removeIndex;
+        i < bracketMap.Size() and bracketMap.GetPosition(i) < position + length;
+        i++
+    )
+    {
+        gint startPos = bracketMap.GetPosition(i);
+        gint endPos = startPos + bracketMap.GetLength(i);
+        // if the end bracket is valid and still present, just recompute it
+        if (endPos > startPos and endPos >= (position + length)) {
+            recomputeRanges.Add(endPos - length);
+        }
+    }
+
+    // remaining brackets are moved backwards
+    if (removeIndex < bracketMap.Size()) {
+        bracketMap.EraseRange(position, position + length);
+        bracketMap.Shift(position + length, -length);
+        madeChange = TRUE;
+    }
+
+    return madeChange;
+}
+
+
+
+// -----------------------------------------------------------------------------
+    gboolean bracket_edit_apply(
+        BracketMap &bracketMap,
+        DirtyRanges &recomputeRanges,
+        EditLog &editLog
+    )
+/*
+    catch up with every logged edit in one pass over the brackets
+----------------------------------------------------------------------------- */
+{
+    if (editLog.Empty()) {
+        return FALSE;
+    }
+
+    editLog.Compact();
+    const std::vector<EditLog::Change> &changes = editLog.mChanges;
+
+    /*
+     * Lengths in the map still describe the text before the log, so every
+     * test is done there and brackets to recompute are mapped forward once
+     * the map has caught up
+     */
+
+    std::vector<gint> recompute;
+
+    /*
+     * Brackets reaching over a change. Each change only looks at brackets
+     * after the previous one, earlier ones reaching over it reach over the
+     * previous change too and were found for that.
+     */
+
+    gsize first = 0;
+    for (const EditLog::Change &change : changes) {
+        gsize last = bracketMap.LowerBound(change.start);
+        bracketMap.Reaching(first, last, change.start, recompute);
+        first = last;
+    }
+
+    // start bracket was deleted, its end bracket is recomputed if it stays
+    for (const EditLog::Change &change : changes) {
+        for (
+            gsize i = bracketMap.LowerBound(change.start);
+            i < bracketMap.Size() and bracketMap.GetPosition(i) < change.end;
+            i++
+        )
+        {
+            gint startPos = bracketMap.GetPosition(i);
+            gint endPos = startPos + bracketMap.GetLength(i);
+            if (endPos > startPos and endPos >= change.end) {
+                recompute.push_back(endPos);
+            }
+        }
+    }
+
+    gboolean madeChange =
+        not recompute.empty() or
+        bracketMap.LowerBound(changes.front().start) < bracketMap.Size();
+
+    bracketMap.Apply(editLog);
+
+    for (gint position : recompute) {
+        gint current;
+        if (editLog.MapForward(position, current)) {
+            recomputeRanges.Add(current);
+        }
+    }
+
+    editLog.Clear();
+
+    return madeChange;
+}
@@ -0,0 +1,63 @@
+/*
+ *      BracketEdits.h
+ *
+ *      Copyright 2023 Asif Amin <asifamin@utexas.edu>
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+#ifndef __BRACKET_EDITS_H__
+#define __BRACKET_EDITS_H__
+
+/* --------------------------------- INCLUDES ------------------------------- */
+
+#include <glib.h>
+
+#include "BracketMap.h"
+#include "DirtyRanges.h"
+#include "EditLog.h"
+
+/* --------------------------------- PROTOTYPES ----------------------------- */
+
+    /*
+     * Keep a bracket map in step with text edits. Brackets whose partner
+     * may have changed are queued in recomputeRanges, both return TRUE if
+     * anything has to be redrawn.
+     */
+
+    gboolean bracket_edit_insert(
+        BracketMap &bracketMap,
+        DirtyRanges &recomputeRanges,
+        gint position, gint length
+    );
+
+    gboolean bracket_edit_delete(
+        BracketMap &bracketMap,
+        DirtyRanges &recomputeRanges,
+        gint position, gint length
+    );
+
+    /*
+     * Same as calling the above for every edit in editLog, but brackets are
+     * only visited once for all of them. The log is cleared.
+     */
+
+    gboolean bracket_edit_apply(
+        BracketMap &bracketMap,
+        DirtyRanges &recomputeRanges,
+        EditLog &editLog
+    );
+
+#endif
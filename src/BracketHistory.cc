@@ -0,0 +1,235 @@
+/*
+ *      BracketHistory.cc
+ *
+ *      Copyright 2023 Asif Amin <asifamin@utexas.edu>
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+/* --------------------------------- INCLUDES ------------------------------- */
+
+#include <utility>
+
+#include "BracketHistory.h"
+
+/* ------------------------------ IMPLEMENTATION ---------------------------- */
+
+
+// -----------------------------------------------------------------------------
+    static guint64 step_hash(
+        gboolean insert,
+        gint position,
+        gint length
+    )
+/*
+    splitmix64 finalizer over the step
+----------------------------------------------------------------------------- */
+{
+    guint64 hash = (guint64(guint32(position)) << 32) | guint32(length);
+    hash ^= insert ? G_GUINT64_CONSTANT(0x9e3779b97f4a7c15) : 0;
+
+    hash = (hash ^ (hash >> 30)) * G_GUINT64_CONSTANT(0xbf58476d1ce4e5b9);
+    hash = (hash ^ (hash >> 27)) * G_GUINT64_CONSTANT(0x94d049bb133111eb);
+    return hash ^ (hash >> 31);
+}
+
+
+
+// -----------------------------------------------------------------------------
+    static void push_entry(
+        std::vector<BracketHistory::Entry> &stack,
+        BracketHistory::Entry &entry
+    )
+/*
+
+----------------------------------------------------------------------------- */
+{
+    if (stack.size() >= BracketHistory::MAX_ENTRIES) {
+        stack.erase(stack.begin());
+    }
+
+    stack.push_back(std::move(entry));
+}
+
+
+
+// -----------------------------------------------------------------------------
+    BracketHistory::BracketHistory()
+/*
+    Constructor
+----------------------------------------------------------------------------- */
+:   mOpen(FALSE),
+    mKind(USER),
+    mAction(),
+    mSettled(FALSE)
+{
+    // nothing to do
+}
+
+
+
+// -----------------------------------------------------------------------------
+    void BracketHistory::Begin(
+        Kind kind,
+        gboolean settled
+    )
+/*
+    settled says whether the bracket map and its queues are done with the
+    text the action starts from
+----------------------------------------------------------------------------- */
+{
+    std::vector<guint8> unused;
+    End(unused);
+
+    // a new user action throws away what could be redone
+    if (kind == USER) {
+        mRedo.clear();
+    }
+
+    mOpen = TRUE;
+    mKind = kind;
+    mAction.signature = mAction.inverse = 0;
+    mAction.length = 0;
+    mAction.blob.clear();
+    mSettled = settled;
+}
+
+
+
+// -----------------------------------------------------------------------------
+    void BracketHistory::Step(
+        gboolean insert,
+        gint position,
+        gint length
+    )
+/*
+    undoing the step deletes what it inserted and the other way around,
+    at the same position
+----------------------------------------------------------------------------- */
+{
+    if (not mOpen) {
+        return;
+    }
+
+    mAction.signature += step_hash(insert, position, length);
+    mAction.inverse += step_hash(not insert, position, length);
+    mAction.length += length;
+}
+
+
+
+// -----------------------------------------------------------------------------
+    void BracketHistory::Capture(
+        const BracketMap &bracketMap
+    )
+/*
+    save the map the action began with if the action is big enough
+----------------------------------------------------------------------------- */
+{
+    if (mOpen and mSettled and mAction.length >= MIN_LENGTH) {
+        bracketMap.Encode(mAction.blob);
+    }
+
+    mSettled = FALSE;
+}
+
+
+
+// -----------------------------------------------------------------------------
+    gboolean BracketHistory::End(
+        std::vector<guint8> &blob
+    )
+/*
+
+----------------------------------------------------------------------------- */
+{
+    if (not mOpen) {
+        return FALSE;
+    }
+
+    mOpen = FALSE;
+
+    if (mAction.length < MIN_LENGTH) {
+        return FALSE;
+    }
+
+    if (mKind == USER) {
+        push_entry(mUndo, mAction);
+        return FALSE;
+    }
+
+    std::vector<Entry> &from = mKind == UNDO ? mUndo : mRedo;
+    std::vector<Entry> &to = mKind == UNDO ? mRedo : mUndo;
+
+    // undo performs the inverse steps of the entry, redo the same ones
+    gboolean matches =
+        not from.empty() and
+        from.back().length == mAction.length and
+        (mKind == UNDO ? from.back().inverse : from.back().signature) ==
+            mAction.signature;
+
+    if (not matches) {
+        // we lost track of the undo stack of the document
+        Clear();
+        return FALSE;
+    }
+
+    Entry &entry = from.back();
+    blob.swap(entry.blob);
+
+    // the map from before this undo or redo, for the opposite one
+    entry.blob.swap(mAction.blob);
+
+    push_entry(to, entry);
+    from.pop_back();
+
+    return not blob.empty();
+}
+
+
+
+// -----------------------------------------------------------------------------
+    void BracketHistory::Clear()
+/*
+
+----------------------------------------------------------------------------- */
+{
+    std::vector<Entry>().swap(mUndo);
+    std::vector<Entry>().swap(mRedo);
+    std::vector<guint8>().swap(mAction.blob);
+    mOpen = FALSE;
+}
+
+
+
+// -----------------------------------------------------------------------------
+    gsize BracketHistory::MemoryUsage() const
+/*
+    bytes held by saved maps, counting reserved capacity
+----------------------------------------------------------------------------- */
+{
+    gsize total =
+        (mUndo.capacity() + mRedo.capacity()) * sizeof(Entry) +
+        mAction.blob.capacity();
+
+    for (const Entry &entry : mUndo) {
+        total += entry.blob.capacity();
+    }
+    for (const Entry &entry : mRedo) {
+        total += entry.blob.capacity();
+    }
+
+    return total;
+}
@@ -0,0 +1,101 @@
+/*
+ *      BracketHistory.h
+ *
+ *      Copyright 2023 Asif Amin <asifamin@utexas.edu>
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+#ifndef __BRACKET_HISTORY_H__
+#define __BRACKET_HISTORY_H__
+
+/* --------------------------------- INCLUDES ------------------------------- */
+
+#include <vector>
+
+#include <glib.h>
+
+#include "BracketMap.h"
+
+/* ----------------------------- CLASS DEFINITIONS -------------------------- */
+
+// -----------------------------------------------------------------------------
+    struct BracketHistory
+/*
+    Purpose:    bracket maps saved around big undo actions
+
+    Follows the undo actions of a document. A big user action keeps the map
+    from before it, encoded with BracketMap::Encode(), on mUndo. Undo is
+    last in first out, so when an undo performs the exact inverse of the
+    newest entry the text is back to what that map was saved for. The
+    entry then moves to mRedo holding the map from before the undo, and a
+    redo of the same steps moves it back.
+
+    Actions are told apart by the sum of a hash of every step, which does
+    not depend on the order steps are undone in. Actions below MIN_LENGTH
+    are not kept, they can never match a kept one. A kept action whose map
+    could not be saved stays as an empty entry so both stacks keep lining
+    up with the undo stack of the document.
+----------------------------------------------------------------------------- */
+{
+    enum Kind {
+        USER,
+        UNDO,
+        REDO
+    };
+
+    struct Entry {
+        guint64 signature, inverse;
+        gsize length;
+        std::vector<guint8> blob;
+    };
+
+    std::vector<Entry> mUndo, mRedo;
+
+    // action in progress
+    gboolean mOpen;
+    Kind mKind;
+    Entry mAction;
+
+    // the bracket map is still what it was when the action began
+    gboolean mSettled;
+
+    BracketHistory();
+
+    void Begin(Kind kind, gboolean settled);
+    void Step(gboolean insert, gint position, gint length);
+
+    // called before the bracket map moves on from the state the action
+    // began in
+    void Capture(const BracketMap &bracketMap);
+
+    /*
+     * Close the action in progress. Returns TRUE if it was an undo or redo
+     * that took the text back to a saved map, which is moved into blob.
+     */
+    gboolean End(std::vector<guint8> &blob);
+
+    void Clear();
+
+    gsize MemoryUsage() const;
+
+    // characters inserted and deleted by an action worth saving a map for
+    static const gsize MIN_LENGTH = 16 * 1024;
+
+    // entries kept on each stack, the oldest are dropped first
+    static const gsize MAX_ENTRIES = 8;
+};
+
+#endif
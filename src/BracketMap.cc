@@ -22,10 +22,11 @@
 # include "config.h"
 #endif
 
-#include <stack>
-#include <set>
+#include <algorithm>
+#include <iterator>
 
 #include "BracketMap.h"
+#include "Varint.h"
 
 
 // -----------------------------------------------------------------------------
@@ -33,87 +34,924 @@
 /*
     Constructor
 ----------------------------------------------------------------------------- */
+:   mGapStart(0),
+    mGapEnd(0),
+    mShift(0),
+    mDirtyFrom(G_MAXINT),
+    mDirtyTo(G_MININT),
+    mStaleFrom(0),
+    mStaleTo(0)
 {
 
 }
 
 
 // -----------------------------------------------------------------------------
-    BracketMap::~BracketMap()
+    void BracketMap::MarkDirty(Index index)
 /*
-    Destructor
+    nesting orders from index onwards need to be recomputed
 ----------------------------------------------------------------------------- */
 {
+    mDirtyFrom = std::min(mDirtyFrom, index);
+    mDirtyTo = std::max(mDirtyTo, index);
+}
+
+
+// -----------------------------------------------------------------------------
+    template<typename T>
+    static void move_block(std::vector<T> &array, gsize from, gsize to, gsize count)
+/*
+
+----------------------------------------------------------------------------- */
+{
+    std::copy(array.begin() + from, array.begin() + from + count, array.begin() + to);
+}
+
+
+// -----------------------------------------------------------------------------
+    template<typename T>
+    static void move_block_back(std::vector<T> &array, gsize from, gsize to, gsize count)
+/*
+    same as move_block() for overlapping ranges where to > from
+----------------------------------------------------------------------------- */
+{
+    std::copy_backward(
+        array.begin() + from, array.begin() + from + count,
+        array.begin() + to + count
+    );
+}
+
+
+// -----------------------------------------------------------------------------
+    void BracketMap::MoveGap(gsize index)
+/*
+    move the gap so it starts at logical index. Entries that cross the gap
+    get mShift added or taken away.
+----------------------------------------------------------------------------- */
+{
+    gsize gapLength = mGapEnd - mGapStart;
+
+    // every entry between the old and the new gap is moved
+    MarkStale(std::min(index, mGapStart), std::max(index + gapLength, mGapEnd));
 
+    if (index < mGapStart) {
+        // entries [index, mGapStart) go after the gap
+        gsize count = mGapStart - index;
+        for (gsize i = index; i < mGapStart; i++) {
+            mPositions[i] -= mShift;
+        }
+        move_block_back(mPositions, index, index + gapLength, count);
+        move_block_back(mLengths, index, index + gapLength, count);
+        move_block_back(mOrders, index, index + gapLength, count);
+        move_block_back(mTypes, index, index + gapLength, count);
+    }
+    else if (index > mGapStart) {
+        // entries after the gap up to index go before it
+        gsize count = index - mGapStart;
+        move_block(mPositions, mGapEnd, mGapStart, count);
+        move_block(mLengths, mGapEnd, mGapStart, count);
+        move_block(mOrders, mGapEnd, mGapStart, count);
+        move_block(mTypes, mGapEnd, mGapStart, count);
+        for (gsize i = mGapStart; i < index; i++) {
+            mPositions[i] += mShift;
+        }
+    }
+
+    mGapStart = index;
+    mGapEnd = index + gapLength;
+
+    // nothing after the gap, start counting shifts again
+    if (mGapEnd == mPositions.size()) {
+        mShift = 0;
+    }
 }
 
 
 // -----------------------------------------------------------------------------
-    void BracketMap::Update(Index index, Length length)
+    void BracketMap::GrowGap()
 /*
+    make room for more entries at the gap
+----------------------------------------------------------------------------- */
+{
+    gsize capacity = mPositions.size();
+    gsize newCapacity = std::max<gsize>(64, capacity * 2);
+    gsize grow = newCapacity - capacity;
+    gsize numAfter = capacity - mGapEnd;
 
+    mPositions.resize(newCapacity);
+    mLengths.resize(newCapacity);
+    mOrders.resize(newCapacity);
+    mTypes.resize(newCapacity);
+
+    move_block_back(mPositions, mGapEnd, mGapEnd + grow, numAfter);
+    move_block_back(mLengths, mGapEnd, mGapEnd + grow, numAfter);
+    move_block_back(mOrders, mGapEnd, mGapEnd + grow, numAfter);
+    move_block_back(mTypes, mGapEnd, mGapEnd + grow, numAfter);
+
+    mGapEnd += grow;
+
+    MarkStale(0, newCapacity);
+}
+
+
+// -----------------------------------------------------------------------------
+    void BracketMap::Insert(
+        gsize index,
+        Index position,
+        Type type,
+        Length length
+    )
+/*
+    new entry at logical index
 ----------------------------------------------------------------------------- */
 {
-    auto it = mBracketMap.find(index);
-    if (it != mBracketMap.end()) {
-        auto &bracket = it->second;
-        GetLength(bracket) = length;
+    MoveGap(index);
+    if (mGapStart == mGapEnd) {
+        GrowGap();
+    }
+
+    mPositions[mGapStart] = position;
+    mLengths[mGapStart] = length;
+    mOrders[mGapStart] = 0;
+    mTypes[mGapStart] = type;
+    MarkStale(mGapStart, mGapStart + 1);
+    mGapStart++;
+}
+
+
+// -----------------------------------------------------------------------------
+    gsize BracketMap::LowerBound(Index position) const
+/*
+
+----------------------------------------------------------------------------- */
+{
+    // the part before the gap holds absolute positions
+    auto beforeGap = mPositions.begin() + mGapStart;
+    auto it = std::lower_bound(mPositions.begin(), beforeGap, position);
+    if (it != beforeGap) {
+        return it - mPositions.begin();
+    }
+
+    auto afterGap = std::lower_bound(
+        mPositions.begin() + mGapEnd, mPositions.end(), position - mShift
+    );
+    return mGapStart + (afterGap - (mPositions.begin() + mGapEnd));
+}
+
+
+// -----------------------------------------------------------------------------
+    gsize BracketMap::Find(Index position) const
+/*
+
+----------------------------------------------------------------------------- */
+{
+    gsize index = LowerBound(position);
+    if (index < Size() and GetPosition(index) == position) {
+        return index;
+    }
+    return NPOS;
+}
+
+
+// -----------------------------------------------------------------------------
+    void BracketMap::MarkStale(gsize from, gsize to)
+/*
+    physical [from, to) was written or joined the gap
+----------------------------------------------------------------------------- */
+{
+    if (from >= to) {
+        return;
+    }
+
+    if (mStaleFrom >= mStaleTo) {
+        mStaleFrom = from;
+        mStaleTo = to;
     }
     else {
-        mBracketMap.insert(
-            std::make_pair(index, std::make_tuple(length, 0))
-        );
+        mStaleFrom = std::min(mStaleFrom, from);
+        mStaleTo = std::max(mStaleTo, to);
     }
 }
 
 
 // -----------------------------------------------------------------------------
-    std::set<BracketMap::Index> BracketMap::ComputeOrder()
+    void BracketMap::RefreshEnds()
 /*
+    bring the blocks of mMaxEnds that were marked stale, and their parents,
+    up to date. The tree is rebuilt when the capacity changed.
+----------------------------------------------------------------------------- */
+{
+    gsize capacity = mPositions.size();
+    gsize numBlocks = (capacity + END_BLOCK - 1) / END_BLOCK;
+    gsize numLeaves = 1;
+    while (numLeaves < numBlocks) {
+        numLeaves *= 2;
+    }
 
+    if (mMaxEnds.size() != 2 * numLeaves) {
+        mMaxEnds.assign(2 * numLeaves, G_MININT);
+        mStaleFrom = 0;
+        mStaleTo = capacity;
+    }
+
+    if (mStaleFrom >= mStaleTo or capacity == 0) {
+        return;
+    }
+
+    gsize firstBlock = mStaleFrom / END_BLOCK;
+    gsize lastBlock = (std::min(mStaleTo, capacity) - 1) / END_BLOCK;
+
+    for (gsize block = firstBlock; block <= lastBlock; block++) {
+        Index maxEnd = G_MININT;
+        gsize end = std::min(capacity, (block + 1) * END_BLOCK);
+        for (gsize physical = block * END_BLOCK; physical < end; physical++) {
+            if (physical < mGapStart or physical >= mGapEnd) {
+                maxEnd = std::max(maxEnd, StoredEnd(physical));
+            }
+        }
+        mMaxEnds[numLeaves + block] = maxEnd;
+    }
+
+    for (
+        gsize first = (numLeaves + firstBlock) / 2, last = (numLeaves + lastBlock) / 2;
+        first > 0;
+        first /= 2, last /= 2
+    )
+    {
+        for (gsize node = first; node <= last; node++) {
+            mMaxEnds[node] = std::max(mMaxEnds[2 * node], mMaxEnds[2 * node + 1]);
+        }
+    }
+
+    mStaleFrom = mStaleTo = 0;
+}
+
+
+// -----------------------------------------------------------------------------
+    void BracketMap::CollectReaching(
+        gsize node, gsize firstBlock, gsize lastBlock,
+        gsize from, gsize to,
+        Index position, std::vector<Index> &found
+    ) const
+/*
+    Reaching() for the blocks [firstBlock, lastBlock) under node, limited to
+    physical [from, to)
 ----------------------------------------------------------------------------- */
 {
-    std::stack<Index> orderStack;
-    std::set<Index> updatedBrackets;
+    gsize start = std::max(firstBlock * END_BLOCK, from);
+    gsize end = std::min(lastBlock * END_BLOCK, to);
+    if (start >= end or mMaxEnds[node] == G_MININT) {
+        return;
+    }
 
-    for (auto &it : mBracketMap) {
+    /*
+     * Ends after the gap are stored without mShift. Where a node holds both
+     * kinds, compare the larger of the two.
+     */
 
-        const Index &startIndex = it.first;
-        Bracket &bracket = it.second;
-        Length length = GetLength(bracket);
-        Index endPos = startIndex + length;
+    gint64 maxEnd = mMaxEnds[node];
+    if (maxEnd != G_MAXINT) {
+        if (start >= mGapEnd) {
+            maxEnd += mShift;
+        }
+        else if (end > mGapEnd) {
+            maxEnd = std::max(maxEnd, maxEnd + mShift);
+        }
+        if (maxEnd < position) {
+            return;
+        }
+    }
 
-        if (length == UNDEFINED) {
-            // Invalid brackets
-            GetOrder(bracket) = UNDEFINED;
+    if (lastBlock - firstBlock > 1) {
+        gsize middle = (firstBlock + lastBlock) / 2;
+        CollectReaching(2 * node, firstBlock, middle, from, to, position, found);
+        CollectReaching(2 * node + 1, middle, lastBlock, from, to, position, found);
+        return;
+    }
+
+    for (gsize physical = start; physical < end; physical++) {
+        if (physical >= mGapStart and physical < mGapEnd) {
+            continue;
+        }
+
+        Index bracketPosition = physical < mGapStart ?
+            mPositions[physical] :
+            mPositions[physical] + mShift;
+        Length length = mLengths[physical];
+
+        if (length == UNDEFINED or bracketPosition + length >= position) {
+            found.push_back(bracketPosition);
+        }
+    }
+}
+
+
+// -----------------------------------------------------------------------------
+    void BracketMap::Reaching(
+        gsize first,
+        gsize last,
+        Index position,
+        std::vector<Index> &found
+    )
+/*
+    walks down the tree of largest ends, skipping every block whose pairs
+    all end before position. Positions are appended in order.
+----------------------------------------------------------------------------- */
+{
+    if (first >= last) {
+        return;
+    }
+
+    RefreshEnds();
+
+    gsize numLeaves = mMaxEnds.size() / 2;
+    CollectReaching(
+        1, 0, numLeaves,
+        Physical(first), Physical(last - 1) + 1,
+        position, found
+    );
+}
+
+
+// -----------------------------------------------------------------------------
+    void BracketMap::Update(Index position, Type type, Length length)
+/*
+
+----------------------------------------------------------------------------- */
+{
+    gsize index = LowerBound(position);
+
+    if (index < Size() and GetPosition(index) == position) {
+        gsize physical = Physical(index);
+        if (mLengths[physical] != length or mTypes[physical] != type) {
+            mLengths[physical] = length;
+            mTypes[physical] = type;
+            MarkStale(physical, physical + 1);
+            MarkDirty(position);
+        }
+    }
+    else {
+        Insert(index, position, type, length);
+        MarkDirty(position);
+    }
+}
+
+
+// -----------------------------------------------------------------------------
+    void BracketMap::Assign(const std::vector<Entry> &brackets)
+/*
+    replace contents with brackets, which must be sorted by position
+----------------------------------------------------------------------------- */
+{
+    Clear();
+
+    gsize size = brackets.size();
+    mPositions.resize(size);
+    mLengths.resize(size);
+    mOrders.assign(size, 0);
+    mTypes.resize(size);
+
+    for (gsize i = 0; i < size; i++) {
+        mPositions[i] = brackets[i].position;
+        mLengths[i] = brackets[i].length;
+        mTypes[i] = brackets[i].type;
+    }
+
+    mGapStart = mGapEnd = size;
+    MarkStale(0, size);
+
+    if (size > 0) {
+        MarkDirty(brackets.front().position);
+        MarkDirty(brackets.back().position);
+    }
+}
+
+
+// -----------------------------------------------------------------------------
+    bool BracketMap::Erase(Index position)
+/*
+    remove bracket at position, returns true if there was one
+----------------------------------------------------------------------------- */
+{
+    gsize numBrackets = Size();
+    EraseRange(position, position + 1);
+    return numBrackets != Size();
+}
+
+
+// -----------------------------------------------------------------------------
+    void BracketMap::EraseRange(Index start, Index end)
+/*
+    remove all brackets in [start, end)
+----------------------------------------------------------------------------- */
+{
+    if (start >= end) {
+        return;
+    }
+
+    gsize first = LowerBound(start);
+    gsize last = LowerBound(end);
+    if (first == last) {
+        return;
+    }
+
+    // erased entries are swallowed by the gap
+    MoveGap(first);
+    MarkStale(mGapEnd, mGapEnd + (last - first));
+    mGapEnd += last - first;
+
+    MarkDirty(start);
+
+    // checkpoints on removed brackets can not be landed on anymore
+    auto firstCheckpoint = std::lower_bound(
+        mCheckpoints.begin(), mCheckpoints.end(), start,
+        [](const Checkpoint &checkpoint, Index index) {
+            return checkpoint.position < index;
+        }
+    );
+    auto lastCheckpoint = firstCheckpoint;
+    while (lastCheckpoint != mCheckpoints.end() and lastCheckpoint->position < end) {
+        lastCheckpoint++;
+    }
+    mCheckpoints.erase(firstCheckpoint, lastCheckpoint);
+}
+
+
+// -----------------------------------------------------------------------------
+    void BracketMap::Shift(Index position, gint delta)
+/*
+    move every bracket at or after position by delta. When shifting
+    backwards the caller must have cleared the range that is moved over.
+----------------------------------------------------------------------------- */
+{
+    if (delta == 0) {
+        return;
+    }
+
+    MoveGap(LowerBound(position));
+    if (mGapEnd < mPositions.size()) {
+        mShift += delta;
+    }
+
+    if (mDirtyFrom <= mDirtyTo) {
+        for (Index *index : { &mDirtyFrom, &mDirtyTo }) {
+            if (*index >= position) {
+                *index += delta;
+            }
+            else if (*index >= position + delta) {
+                *index = position + delta;
+            }
+        }
+    }
+
+    /*
+     * Saved stacks move with the text. Ends that were moved over can never
+     * match again, so make sure they don't compare equal to a real position.
+     */
+
+    auto first = std::lower_bound(
+        mCheckpoints.begin(), mCheckpoints.end(), position,
+        [](const Checkpoint &checkpoint, Index index) {
+            return checkpoint.position < index;
+        }
+    );
+    for (auto it = first; it != mCheckpoints.end(); it++) {
+        it->position += delta;
+        for (auto &stack : it->stacks) {
+            for (auto &endPos : stack) {
+                if (endPos >= position) {
+                    endPos += delta;
+                }
+                else if (endPos >= position + delta) {
+                    endPos = UNDEFINED - 1;
+                }
+            }
+        }
+    }
+}
+
+
+// -----------------------------------------------------------------------------
+    void BracketMap::Apply(const EditLog &editLog)
+/*
+    what EraseRange() and Shift() do for every change of the log. Only
+    brackets from the first change to the last one are visited, the ones
+    after it move with mShift.
+----------------------------------------------------------------------------- */
+{
+    const std::vector<EditLog::Change> &changes = editLog.mChanges;
+    if (changes.empty()) {
+        return;
+    }
+
+    Index firstStart = changes.front().start;
+
+    /*
+     * A saved stack before the first change can only hold ends past it for
+     * pairs reaching over it, so checkpoints before the first of those and
+     * before the dirty range stay as they are
+     */
+
+    Index firstAffected = std::min(firstStart, mDirtyFrom);
+    gsize first = LowerBound(firstStart);
+
+    std::vector<Index> reaching;
+    Reaching(0, first, firstStart, reaching);
+    for (Index position : reaching) {
+        if (GetLength(LowerBound(position)) != UNDEFINED) {
+            firstAffected = std::min(firstAffected, position);
+            break;
+        }
+    }
+
+    if (mDirtyFrom <= mDirtyTo) {
+        for (Index *index : { &mDirtyFrom, &mDirtyTo }) {
+            editLog.MapForward(*index, *index);
+        }
+    }
+
+    // brackets up to the end of the last change are taken from after the
+    // gap to before it, dropping the replaced ones
+    gsize last = LowerBound(changes.back().end);
+    MoveGap(first);
+
+    gsize from = mGapEnd;
+    gsize to = mGapEnd + (last - first);
+    gsize out = mGapStart;
+    gint delta = 0;
+    auto change = changes.begin();
+
+    for (gsize physical = from; physical < to; physical++) {
+        Index position = mPositions[physical] + mShift;
+
+        while (change != changes.end() and change->end <= position) {
+            delta = change->current + change->length - change->end;
+            change++;
+        }
+
+        if (change != changes.end() and position >= change->start) {
+            MarkDirty(change->current);
             continue;
         }
 
+        mPositions[out] = position + delta;
+        mLengths[out] = mLengths[physical];
+        mOrders[out] = mOrders[physical];
+        mTypes[out] = mTypes[physical];
+        out++;
+    }
+
+    MarkStale(mGapStart, to);
+    mGapStart = out;
+    mGapEnd = to;
 
-        if (orderStack.size() == 0) {
-            // First bracket
-            orderStack.push(endPos);
+    if (mGapEnd < mPositions.size()) {
+        const EditLog::Change &lastChange = changes.back();
+        mShift += lastChange.current + lastChange.length - lastChange.end;
+    }
+    else {
+        mShift = 0;
+    }
+
+    // checkpoints on removed brackets are dropped, removed ends never match
+    auto firstCheckpoint = std::lower_bound(
+        mCheckpoints.begin(), mCheckpoints.end(), firstAffected,
+        [](const Checkpoint &checkpoint, Index index) {
+            return checkpoint.position < index;
         }
-        else if (startIndex > orderStack.top()) {
-            // not nested
-            while(orderStack.size() > 0 and orderStack.top() < startIndex) {
-                orderStack.pop();
+    );
+
+    gsize numCheckpoints = firstCheckpoint - mCheckpoints.begin();
+    for (gsize i = numCheckpoints; i < mCheckpoints.size(); i++) {
+        Checkpoint &checkpoint = mCheckpoints[i];
+        if (not editLog.MapForward(checkpoint.position, checkpoint.position)) {
+            continue;
+        }
+
+        for (auto &stack : checkpoint.stacks) {
+            for (auto &endPos : stack) {
+                if (not editLog.MapForward(endPos, endPos)) {
+                    endPos = UNDEFINED - 1;
+                }
             }
-            orderStack.push(endPos);
+        }
+
+        if (numCheckpoints != i) {
+            mCheckpoints[numCheckpoints] = std::move(checkpoint);
+        }
+        numCheckpoints++;
+    }
+    mCheckpoints.resize(numCheckpoints);
+}
+
+
+// -----------------------------------------------------------------------------
+    void BracketMap::Clear()
+/*
+
+----------------------------------------------------------------------------- */
+{
+    mPositions.clear();
+    mLengths.clear();
+    mOrders.clear();
+    mTypes.clear();
+    mGapStart = mGapEnd = 0;
+    mShift = 0;
+
+    mMaxEnds.clear();
+    mStaleFrom = mStaleTo = 0;
+
+    mCheckpoints.clear();
+    mDirtyFrom = G_MAXINT;
+    mDirtyTo = G_MININT;
+}
+
+
+// -----------------------------------------------------------------------------
+    void BracketMap::Swap(BracketMap &other)
+/*
+    exchange contents, lets a map built elsewhere be taken over in O(1)
+----------------------------------------------------------------------------- */
+{
+    mPositions.swap(other.mPositions);
+    mLengths.swap(other.mLengths);
+    mOrders.swap(other.mOrders);
+    mTypes.swap(other.mTypes);
+    std::swap(mGapStart, other.mGapStart);
+    std::swap(mGapEnd, other.mGapEnd);
+    std::swap(mShift, other.mShift);
+    std::swap(mDirtyFrom, other.mDirtyFrom);
+    std::swap(mDirtyTo, other.mDirtyTo);
+    mCheckpoints.swap(other.mCheckpoints);
+    mMaxEnds.swap(other.mMaxEnds);
+    std::swap(mStaleFrom, other.mStaleFrom);
+    std::swap(mStaleTo, other.mStaleTo);
+}
+
+
+// -----------------------------------------------------------------------------
+    gsize BracketMap::MemoryUsage() const
+/*
+    heap bytes held, counting reserved capacity
+----------------------------------------------------------------------------- */
+{
+    gsize capacity = mPositions.capacity();
+    gsize bytes =
+        capacity * sizeof(Index) +
+        mLengths.capacity() * sizeof(Length) +
+        mOrders.capacity() * sizeof(Order) +
+        mTypes.capacity() * sizeof(Type) +
+        mMaxEnds.capacity() * sizeof(Index);
+
+    bytes += mCheckpoints.capacity() * sizeof(Checkpoint);
+    for (const Checkpoint &checkpoint : mCheckpoints) {
+        for (const auto &stack : checkpoint.stacks) {
+            bytes += stack.capacity() * sizeof(Index);
+        }
+    }
+
+    return bytes;
+}
+
+
+// -----------------------------------------------------------------------------
+    void BracketMap::Encode(std::vector<guint8> &blob) const
+/*
+    bracket count, then for every bracket the distance to the previous one
+    with the type in the low bits, followed by the zigzag encoded length.
+    Brackets are close together, so most of them take two or three bytes.
+----------------------------------------------------------------------------- */
+{
+    static_assert(BracketType::COUNT <= 4, "type must fit in two bits");
+
+    blob.clear();
+
+    gsize size = Size();
+    put_varint(blob, size);
+
+    Index previous = 0;
+    for (gsize index = 0; index < size; index++) {
+        gsize physical = Physical(index);
+        Index position = GetPosition(index);
+        Length length = mLengths[physical];
+
+        put_varint(blob, (guint64(position - previous) << 2) | mTypes[physical]);
+        put_varint(blob, zigzag_encode(length));
+
+        previous = position;
+    }
+}
+
+
+// -----------------------------------------------------------------------------
+    bool BracketMap::Decode(const guint8 *blob, gsize size, Index textLength)
+/*
+    replace contents with what Encode() wrote, ComputeOrder() must be called
+    afterwards. Returns false and leaves the map empty if blob is malformed
+    or has a bracket outside of the first textLength characters.
+----------------------------------------------------------------------------- */
+{
+    Clear();
+
+    const guint8 *data = blob;
+    const guint8 *end = blob + size;
+
+    // every bracket takes at least two bytes
+    guint64 count;
+    if (not get_varint(data, end, count) or count > size / 2) {
+        return false;
+    }
+
+    mPositions.resize(count);
+    mLengths.resize(count);
+    mOrders.assign(count, 0);
+    mTypes.resize(count);
+
+    Index position = 0;
+    for (gsize i = 0; i < count; i++) {
+        guint64 delta, length;
+        if (not get_varint(data, end, delta) or not get_varint(data, end, length)) {
+            Clear();
+            return false;
+        }
+
+        // positions increase and every pair ends inside the text
+        guint64 distance = delta >> 2;
+        Length bracketLength = zigzag_decode(length);
+        if (
+            (i > 0 and distance == 0) or
+            distance >= guint64(textLength - position) or
+            (delta & 0x03) >= BracketType::COUNT or
+            (bracketLength != UNDEFINED and bracketLength < 0) or
+            (bracketLength != UNDEFINED and
+                bracketLength >= textLength - position - Index(distance))
+        ) {
+            Clear();
+            return false;
+        }
+
+        position += distance;
+        mPositions[i] = position;
+        mTypes[i] = delta & 0x03;
+        mLengths[i] = bracketLength;
+    }
+
+    mGapStart = mGapEnd = count;
+    MarkStale(0, count);
+
+    if (count > 0) {
+        MarkDirty(mPositions.front());
+        MarkDirty(mPositions.back());
+    }
+
+    return true;
+}
+
+
+// -----------------------------------------------------------------------------
+    static bool same_stacks(
+        const std::vector<BracketMap::Index> (&a)[BracketType::COUNT],
+        const std::vector<BracketMap::Index> (&b)[BracketType::COUNT]
+    )
+/*
+
+----------------------------------------------------------------------------- */
+{
+    for (guint type = 0; type < BracketType::COUNT; type++) {
+        if (a[type] != b[type]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+// -----------------------------------------------------------------------------
+    void BracketMap::ComputeOrder(std::vector<Index> &updatedBrackets)
+/*
+    recompute nesting orders from the dirty range onwards, brackets whose
+    order changed are appended to updatedBrackets. Every type nests on its
+    own and has its own order stack.
+----------------------------------------------------------------------------- */
+{
+    if (mDirtyFrom > mDirtyTo) {
+        return;
+    }
+
+    /*
+     * Resume from the last checkpoint strictly before the dirty range
+     */
+
+    auto resume = std::lower_bound(
+        mCheckpoints.begin(), mCheckpoints.end(), mDirtyFrom,
+        [](const Checkpoint &checkpoint, Index index) {
+            return checkpoint.position < index;
+        }
+    );
+
+    Checkpoint current;
+    gsize index = 0;
+
+    if (resume != mCheckpoints.begin()) {
+        const Checkpoint &checkpoint = *(resume - 1);
+        for (guint type = 0; type < BracketType::COUNT; type++) {
+            current.stacks[type] = checkpoint.stacks[type];
+        }
+        index = LowerBound(checkpoint.position + 1);
+    }
+
+    gsize resumeIndex = resume - mCheckpoints.begin();
+    gsize nextSaved = resumeIndex;
+    gsize convergedAt = mCheckpoints.size();
+    gsize sinceCheckpoint = 0;
+    std::vector<Checkpoint> newCheckpoints;
+
+    gsize size = Size();
+    for (; index < size; index++) {
+
+        gsize physical = Physical(index);
+        const Index startIndex = GetPosition(index);
+        Length length = mLengths[physical];
+        Index endPos = startIndex + length;
+
+        if (length == UNDEFINED) {
+            // Invalid brackets
+            mOrders[physical] = UNDEFINED;
         }
         else {
-            // nested bracket
-            orderStack.push(endPos);
+
+            std::vector<Index> &orderStack = current.stacks[mTypes[physical]];
+
+            if (orderStack.size() == 0) {
+                // First bracket
+                orderStack.push_back(endPos);
+            }
+            else if (startIndex > orderStack.back()) {
+                // not nested
+                while(orderStack.size() > 0 and orderStack.back() < startIndex) {
+                    orderStack.pop_back();
+                }
+                orderStack.push_back(endPos);
+            }
+            else {
+                // nested bracket
+                orderStack.push_back(endPos);
+            }
+
+            Order newOrder = std::min<gsize>(orderStack.size() - 1, G_MAXINT16);
+            if (newOrder != mOrders[physical]) {
+                updatedBrackets.push_back(startIndex);
+            }
+
+            mOrders[physical] = newOrder;
         }
 
-        Order newOrder = orderStack.size() - 1;
-        Order currOrder = GetOrder(bracket);
-        if (newOrder != currOrder) {
-            updatedBrackets.insert(startIndex);
+        /*
+         * Compare against, or replace, the checkpoints saved last time
+         */
+
+        while (
+            nextSaved < mCheckpoints.size() and
+            mCheckpoints[nextSaved].position < startIndex
+        ) {
+            nextSaved++;
         }
 
-        GetOrder(bracket) = newOrder;
+        if (
+            nextSaved < mCheckpoints.size() and
+            mCheckpoints[nextSaved].position == startIndex
+        ) {
+            if (
+                startIndex > mDirtyTo and
+                same_stacks(mCheckpoints[nextSaved].stacks, current.stacks)
+            ) {
+                // everything past here is unchanged
+                convergedAt = nextSaved;
+                break;
+            }
+
+            current.position = startIndex;
+            newCheckpoints.push_back(current);
+            nextSaved++;
+            sinceCheckpoint = 0;
+        }
+        else if (++sinceCheckpoint >= CHECKPOINT_INTERVAL) {
+            current.position = startIndex;
+            newCheckpoints.push_back(current);
+            sinceCheckpoint = 0;
+        }
     }
 
-    return updatedBrackets;
+    mCheckpoints.erase(
+        mCheckpoints.begin() + resumeIndex,
+        mCheckpoints.begin() + convergedAt
+    );
+    mCheckpoints.insert(
+        mCheckpoints.begin() + resumeIndex,
+        std::make_move_iterator(newCheckpoints.begin()),
+        std::make_move_iterator(newCheckpoints.end())
+    );
+
+    mDirtyFrom = G_MAXINT;
+    mDirtyTo = G_MININT;
 }
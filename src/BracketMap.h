@@ -21,44 +21,151 @@
 #ifndef __BRACKET_MAP_H__
 #define __BRACKET_MAP_H__
 
-#include <map>
-#include <tuple>
-#include <set>
+#include <vector>
+#include <utility>
 
 #include <glib.h>
 
+#include "BracketClassifier.h"
+#include "EditLog.h"
 
 // -----------------------------------------------------------------------------
     struct BracketMap
 /*
     Purpose:    data structure which stores and computes nesting order
+
+    Brackets of every type are kept in one table sorted by position, as
+    parallel arrays of position, length to the partner, nesting order and
+    type. Entries are addressed by their index in position order and looked
+    up with a binary search.
+
+    The arrays are gap buffers. Edits move the gap to where they happen with
+    a block move, so inserting, erasing and shifting brackets near the last
+    edit is cheap. Positions of entries after the gap are stored without
+    mShift, so shifting everything after an edit only changes mShift.
+
+    Brackets reaching over an edit are found with a tree holding the largest
+    end in every block of physical entries, so finding them costs about the
+    nesting depth at the edit, not the number of brackets before it.
+
+    Nesting orders are recomputed incrementally. Changes mark a dirty range
+    and the order stacks are saved every so often, so ComputeOrder() resumes
+    from the last checkpoint before the dirty range and stops once the stacks
+    match a checkpoint saved past it.
 ----------------------------------------------------------------------------- */
 {
-    typedef gint Length, Order, Index;
-    typedef std::tuple<Length, Order> Bracket;
-    std::map<Index, Bracket> mBracketMap;
+    typedef gint Length, Index;
+    typedef gint16 Order;
+    typedef guint8 Type;
+
+    // bracket as handed to Assign()
+    struct Entry {
+        Index position;
+        Length length;
+        Type type;
+    };
+
+    // saved order stacks after the bracket at position was processed
+    struct Checkpoint {
+        Index position;
+        std::vector<Index> stacks[BracketType::COUNT];
+    };
+
+    std::vector<Index> mPositions;
+    std::vector<Length> mLengths;
+    std::vector<Order> mOrders;
+    std::vector<Type> mTypes;
+
+    // physical [mGapStart, mGapEnd) is unused
+    gsize mGapStart, mGapEnd;
+    gint mShift;
+
+    Index mDirtyFrom, mDirtyTo;
+    std::vector<Checkpoint> mCheckpoints;
+
+    // largest stored end in every block of END_BLOCK physical entries, with
+    // the maxima of their parents above them, see Reaching()
+    std::vector<Index> mMaxEnds;
+
+    // physical [mStaleFrom, mStaleTo) changed since mMaxEnds was refreshed
+    gsize mStaleFrom, mStaleTo;
 
     BracketMap();
-    ~BracketMap();
 
-    void Update(Index index, Length length);
-    std::set<Index> ComputeOrder();
+    BracketMap(const BracketMap &) = delete;
+    BracketMap& operator=(const BracketMap &) = delete;
 
-    static const gint UNDEFINED = -1;
+    void Update(Index position, Type type, Length length);
+    void Assign(const std::vector<Entry> &brackets);
+    void ComputeOrder(std::vector<Index> &updatedBrackets);
 
-    static Length& GetLength(Bracket &bracket) {
-        return std::get<0>(bracket);
+    // index of the bracket at position, or NPOS
+    gsize Find(Index position) const;
+
+    // index of first bracket at or after position, Size() if none
+    gsize LowerBound(Index position) const;
+
+    // append positions of brackets with index in [first, last) which are
+    // unmatched or whose partner is at or after position
+    void Reaching(gsize first, gsize last, Index position, std::vector<Index> &found);
+
+    bool Erase(Index position);
+    void EraseRange(Index start, Index end);
+    void Shift(Index position, gint delta);
+    void Clear();
+    void Swap(BracketMap &other);
+
+    // EraseRange() and Shift() for every change of a compacted log
+    void Apply(const EditLog &editLog);
+
+    gsize Size() const { return mPositions.size() - (mGapEnd - mGapStart); }
+    gsize MemoryUsage() const;
+
+    // compact copy of the brackets, nesting orders are not kept
+    void Encode(std::vector<guint8> &blob) const;
+    bool Decode(const guint8 *blob, gsize size, Index textLength = G_MAXINT);
+    bool Decode(const std::vector<guint8> &blob, Index textLength = G_MAXINT) {
+        return Decode(blob.data(), blob.size(), textLength);
     }
-    static Order& GetOrder(Bracket &bracket) {
-        return std::get<1>(bracket);
+
+    Index GetPosition(gsize index) const {
+        return index < mGapStart ?
+            mPositions[index] :
+            mPositions[Physical(index)] + mShift;
     }
+    Length GetLength(gsize index) const { return mLengths[Physical(index)]; }
+    Order GetOrder(gsize index) const { return mOrders[Physical(index)]; }
+    Type GetType(gsize index) const { return mTypes[Physical(index)]; }
+
+    static const gint UNDEFINED = -1;
+    static const gsize NPOS = G_MAXSIZE;
+    static const gsize CHECKPOINT_INTERVAL = 64;
+    static const gsize END_BLOCK = 16;
 
-    static const Length& GetLength(const Bracket &bracket) {
-        return std::get<0>(bracket);
+private:
+    gsize Physical(gsize index) const {
+        return index < mGapStart ? index : index + (mGapEnd - mGapStart);
     }
-    static const Order& GetOrder(const Bracket &bracket) {
-        return std::get<1>(bracket);
+
+    // end of the pair at physical, without mShift after the gap
+    Index StoredEnd(gsize physical) const {
+        return mLengths[physical] == UNDEFINED ?
+            G_MAXINT :
+            mPositions[physical] + mLengths[physical];
     }
+
+    void MarkStale(gsize from, gsize to);
+    void RefreshEnds();
+    void CollectReaching(
+        gsize node, gsize firstBlock, gsize lastBlock,
+        gsize from, gsize to,
+        Index position, std::vector<Index> &found
+    ) const;
+
+    void MarkDirty(Index index);
+    void MoveGap(gsize index);
+    void GrowGap();
+    void Insert(gsize index, Index position, Type type, Length length);
 };
 
 #endif
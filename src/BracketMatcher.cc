@@ -0,0 +1,153 @@
+/*
+ *      BracketMatcher.cc
+ *
+ *      Copyright 2023 Asif Amin <asifamin@utexas.edu>
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+
+/* --------------------------------- INCLUDES ------------------------------- */
+
+#include "BracketMatcher.h"
+
+/* ------------------------------ IMPLEMENTATION ---------------------------- */
+
+
+// -----------------------------------------------------------------------------
+    void BracketMatcher::Run(
+        const std::vector<StyledBracket> &brackets,
+        const CodeStyleSet &codeStyles,
+        const gboolean enabled[BracketType::COUNT]
+    )
+/*
+    brackets must be sorted by position. Results replace mMatches, one
+    entry per open bracket in position order.
+----------------------------------------------------------------------------- */
+{
+    for (guint type = 0; type < BracketType::COUNT; type++) {
+        mMatches[type].clear();
+        mUnmatchedCloses[type].clear();
+        mUnmatchedOpens[type].clear();
+    }
+
+    for (const StyledBracket &bracket : brackets) {
+
+        if (not codeStyles.test(bracket.style)) {
+            continue;
+        }
+
+        BracketType type = bracket_class_type(bracket.bracketClass);
+        if (enabled[type] == FALSE) {
+            continue;
+        }
+
+        std::vector<Match> &matches = mMatches[type];
+        std::vector<gsize> &stack = mStacks[type][bracket.style];
+
+        if (bracket.bracketClass & BC_CLASS_OPEN) {
+            stack.push_back(matches.size());
+            matches.push_back({ bracket.position, UNDEFINED });
+        }
+        else if (stack.size()) {
+            Match &match = matches[stack.back()];
+            match.length = bracket.position - match.position;
+            stack.pop_back();
+        }
+        else {
+            // an earlier chunk may still have an opening one for it
+            mUnmatchedCloses[type].push_back({ bracket.position, bracket.style });
+        }
+    }
+
+    for (guint type = 0; type < BracketType::COUNT; type++) {
+        for (guint style = 0; style < 256; style++) {
+            std::vector<gsize> &stack = mStacks[type][style];
+            for (gsize index : stack) {
+                mUnmatchedOpens[type].push_back(
+                    { static_cast<gint>(index), static_cast<guint8>(style) }
+                );
+            }
+            stack.clear();
+        }
+    }
+}
+
+
+
+// -----------------------------------------------------------------------------
+    void BracketMatcher::Combine(
+        const std::vector<BracketMatcher> &chunks
+    )
+/*
+    join chunks that were Run() over consecutive parts of a document, the
+    result is the same as a single Run() over all of it. Only unpaired
+    brackets are looked at, carried from chunk to chunk in mStacks.
+
+    Within a chunk, every unpaired opening bracket of a style comes after
+    every unpaired closing one of that style, so the closing ones consume
+    what earlier chunks left open before the chunk's own are pushed.
+----------------------------------------------------------------------------- */
+{
+    for (guint type = 0; type < BracketType::COUNT; type++) {
+
+        std::vector<Match> &matches = mMatches[type];
+
+        gsize numMatches = 0;
+        for (const BracketMatcher &chunk : chunks) {
+            numMatches += chunk.mMatches[type].size();
+        }
+
+        matches.clear();
+        matches.reserve(numMatches);
+        mUnmatchedCloses[type].clear();
+        mUnmatchedOpens[type].clear();
+
+        for (const BracketMatcher &chunk : chunks) {
+
+            gsize base = matches.size();
+            matches.insert(
+                matches.end(),
+                chunk.mMatches[type].begin(), chunk.mMatches[type].end()
+            );
+
+            for (const Unmatched &close : chunk.mUnmatchedCloses[type]) {
+                std::vector<gsize> &stack = mStacks[type][close.style];
+                if (stack.size()) {
+                    Match &match = matches[stack.back()];
+                    match.length = close.position - match.position;
+                    stack.pop_back();
+                }
+                else {
+                    mUnmatchedCloses[type].push_back(close);
+                }
+            }
+
+            for (const Unmatched &open : chunk.mUnmatchedOpens[type]) {
+                mStacks[type][open.style].push_back(base + open.position);
+            }
+        }
+
+        for (guint style = 0; style < 256; style++) {
+            std::vector<gsize> &stack = mStacks[type][style];
+            for (gsize index : stack) {
+                mUnmatchedOpens[type].push_back(
+                    { static_cast<gint>(index), static_cast<guint8>(style) }
+                );
+            }
+            stack.clear();
+        }
+    }
+}
@@ -0,0 +1,92 @@
+/*
+ *      BracketMatcher.h
+ *
+ *      Copyright 2023 Asif Amin <asifamin@utexas.edu>
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+#ifndef __BRACKET_MATCHER_H__
+#define __BRACKET_MATCHER_H__
+
+/* --------------------------------- INCLUDES ------------------------------- */
+
+#include <bitset>
+#include <vector>
+
+#include <glib.h>
+
+#include "BracketClassifier.h"
+
+/* ----------------------------------- TYPES -------------------------------- */
+
+    typedef std::bitset<256> CodeStyleSet;
+
+/* ----------------------------- CLASS DEFINITIONS -------------------------- */
+
+// -----------------------------------------------------------------------------
+    struct BracketMatcher
+/*
+    Purpose:    pair every bracket of a document in one pass
+
+    Follows the rules of SCI_BRACEMATCH: a bracket only pairs with brackets
+    of the same type and style. Brackets that are not in a code style are
+    skipped entirely, like is_ignore_style() does.
+
+    A document can also be split into chunks that are matched on their own,
+    possibly in parallel. Each chunk remembers the brackets it could not
+    pair and Combine() joins the chunks in order.
+----------------------------------------------------------------------------- */
+{
+    struct StyledBracket {
+        gint position;
+        guint8 bracketClass;
+        guint8 style;
+    };
+
+    // open bracket, length is UNDEFINED if it has no match
+    struct Match {
+        gint position;
+        gint length;
+    };
+
+    // bracket left unpaired by Run(), index is into mMatches for opens
+    struct Unmatched {
+        gint position;
+        guint8 style;
+    };
+
+    std::vector<Match> mMatches[BracketType::COUNT];
+
+    // closing brackets in position order, open ones bottom of stack first
+    std::vector<Unmatched> mUnmatchedCloses[BracketType::COUNT];
+    std::vector<Unmatched> mUnmatchedOpens[BracketType::COUNT];
+
+    void Run(
+        const std::vector<StyledBracket> &brackets,
+        const CodeStyleSet &codeStyles,
+        const gboolean enabled[BracketType::COUNT]
+    );
+
+    void Combine(const std::vector<BracketMatcher> &chunks);
+
+    static const gint UNDEFINED = -1;
+
+private:
+    // index into mMatches of unclosed brackets, by type and style
+    std::vector<gsize> mStacks[BracketType::COUNT][256];
+};
+
+#endif
@@ -0,0 +1,101 @@
+/*
+ *      BracketScanner.cc
+ *
+ *      Copyright 2023 Asif Amin <asifamin@utexas.edu>
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+
+/* --------------------------------- INCLUDES ------------------------------- */
+
+#include "BracketScanner.h"
+#include "Metrics.h"
+
+/* ------------------------------ IMPLEMENTATION ---------------------------- */
+
+
+// -----------------------------------------------------------------------------
+    BracketScanner::BracketScanner(ScintillaObject *sci)
+/*
+    Constructor
+----------------------------------------------------------------------------- */
+:   mSci(sci)
+{
+    // nothing to do
+}
+
+
+
+// -----------------------------------------------------------------------------
+    gint BracketScanner::GetGapPosition() const
+/*
+
+----------------------------------------------------------------------------- */
+{
+    BC_METRICS_COUNT_MESSAGE(SCI_GETGAPPOSITION);
+    return scintilla_send_message(mSci, SCI_GETGAPPOSITION, 0, 0);
+}
+
+
+
+// -----------------------------------------------------------------------------
+    const gchar* BracketScanner::GetRangePointer(gint start, gint length) const
+/*
+    pointer into the document, valid until the next modification
+----------------------------------------------------------------------------- */
+{
+    BC_METRICS_COUNT_MESSAGE(SCI_GETRANGEPOINTER);
+    return reinterpret_cast<const gchar *>(
+        scintilla_send_message(mSci, SCI_GETRANGEPOINTER, start, length)
+    );
+}
+
+
+
+// -----------------------------------------------------------------------------
+    void BracketScanner::GetStyles(
+        gint start, gint end,
+        std::vector<guint8> &styles
+    ) const
+/*
+    style bytes of [start, end), one SCI_GETSTYLEDTEXT per block
+----------------------------------------------------------------------------- */
+{
+    styles.resize(std::max(end - start, 0));
+
+    // SCI_GETSTYLEDTEXT fills in character and style pairs plus a terminator
+    std::vector<gchar> styledText(2 * std::min(end - start, BLOCK_SIZE) + 2);
+
+    for (gint position = start; position < end; position += BLOCK_SIZE) {
+
+        gint length = std::min(end - position, BLOCK_SIZE);
+
+        Sci_TextRange range;
+        range.chrg.cpMin = position;
+        range.chrg.cpMax = position + length;
+        range.lpstrText = styledText.data();
+
+        BC_METRICS_COUNT_MESSAGE(SCI_GETSTYLEDTEXT);
+        scintilla_send_message(
+            mSci, SCI_GETSTYLEDTEXT, 0, reinterpret_cast<sptr_t>(&range)
+        );
+
+        guint8 *out = styles.data() + (position - start);
+        for (gint i = 0; i < length; i++) {
+            out[i] = styledText[2 * i + 1];
+        }
+    }
+}
@@ -0,0 +1,94 @@
+/*
+ *      BracketScanner.h
+ *
+ *      Copyright 2023 Asif Amin <asifamin@utexas.edu>
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+#ifndef __BRACKET_SCANNER_H__
+#define __BRACKET_SCANNER_H__
+
+/* --------------------------------- INCLUDES ------------------------------- */
+
+#include <algorithm>
+#include <vector>
+
+#include <geanyplugin.h>
+
+/* ----------------------------- CLASS DEFINITIONS -------------------------- */
+
+// -----------------------------------------------------------------------------
+    struct BracketScanner
+/*
+    Purpose:    read document text in large contiguous slices
+
+    Scintilla stores text in a gap buffer. Asking for a range pointer that
+    spans the gap makes Scintilla move the gap, so ranges are split at the
+    gap and each side is read in place.
+----------------------------------------------------------------------------- */
+{
+    ScintillaObject *mSci;
+
+    BracketScanner(ScintillaObject *sci);
+
+    gint GetGapPosition() const;
+    const gchar* GetRangePointer(gint start, gint length) const;
+
+    void GetStyles(gint start, gint end, std::vector<guint8> &styles) const;
+
+    // text is handed out in blocks of at most this size by ForEachBlock()
+    static constexpr gint BLOCK_SIZE = 64 * 1024;
+
+    /*
+     * callback(const gchar *text, gint position, gint length) is called for
+     * every contiguous slice of [start, end). The document must not be
+     * modified from the callback.
+     */
+
+    template<typename Callback>
+    void ForEachSlice(gint start, gint end, Callback callback) const
+    {
+        if (start >= end) {
+            return;
+        }
+
+        gint gap = GetGapPosition();
+        gint splits[] = { start, std::min(std::max(gap, start), end), end };
+
+        for (guint i = 0; i < 2; i++) {
+            gint length = splits[i + 1] - splits[i];
+            if (length > 0) {
+                callback(GetRangePointer(splits[i], length), splits[i], length);
+            }
+        }
+    }
+
+    // same as ForEachSlice() but slices are cut into BLOCK_SIZE pieces
+    template<typename Callback>
+    void ForEachBlock(gint start, gint end, Callback callback) const
+    {
+        ForEachSlice(start, end,
+            [&](const gchar *text, gint position, gint length) {
+                for (gint offset = 0; offset < length; offset += BLOCK_SIZE) {
+                    gint blockLength = std::min(length - offset, BLOCK_SIZE);
+                    callback(text + offset, position + offset, blockLength);
+                }
+            }
+        );
+    }
+};
+
+#endif
@@ -62,6 +62,22 @@
 
 
 
+// -----------------------------------------------------------------------------
+    IntegerSetting::IntegerSetting(
+        std::string group,
+        std::string key,
+        gpointer value
+    )
+/*
+    Constructor
+----------------------------------------------------------------------------- */
+:   BracketColorsPluginSetting(group, key, value)
+{
+    // nothing to do
+}
+
+
+
 // -----------------------------------------------------------------------------
     ColorSetting::ColorSetting(
         std::string group,
@@ -108,6 +124,36 @@
 
 
 
+// -----------------------------------------------------------------------------
+    bool IntegerSetting::read(GKeyFile *kf)
+/*
+
+----------------------------------------------------------------------------- */
+{
+    gint *anInt = static_cast<gint *>(mValue);
+    *anInt = utils_get_setting_integer(
+        kf, mGroup.c_str(), mKey.c_str(), *anInt
+    );
+    return true;
+}
+
+
+
+// -----------------------------------------------------------------------------
+    bool IntegerSetting::write(GKeyFile *kf)
+/*
+
+----------------------------------------------------------------------------- */
+{
+    const gint *anInt = static_cast<gint *>(mValue);
+    g_key_file_set_integer(
+        kf, mGroup.c_str(), mKey.c_str(), *anInt
+    );
+    return true;
+}
+
+
+
 // -----------------------------------------------------------------------------
     bool ColorSetting::read(GKeyFile *kf)
 /*
@@ -227,6 +273,12 @@
 
 ----------------------------------------------------------------------------- */
 :   mUseDefaults(useDefaults),
+    mBackgroundAnalysis(TRUE),
+    mParallelMinSize(8 * 1024 * 1024),
+    mMemoryBudget(256),
+    mRebuildThreshold(25),
+    mDiskCache(TRUE),
+    mRecordTraces(FALSE),
     mColors(colors),
     mCustomColors(mColors)
 {
@@ -234,6 +286,30 @@
         std::make_shared<BooleanSetting>("general", "defaults", &mUseDefaults)
     );
 
+    mPluginSettings.push_back(
+        std::make_shared<BooleanSetting>("general", "background_analysis", &mBackgroundAnalysis)
+    );
+
+    mPluginSettings.push_back(
+        std::make_shared<IntegerSetting>("general", "parallel_min_size", &mParallelMinSize)
+    );
+
+    mPluginSettings.push_back(
+        std::make_shared<IntegerSetting>("general", "memory_budget_mib", &mMemoryBudget)
+    );
+
+    mPluginSettings.push_back(
+        std::make_shared<IntegerSetting>("general", "rebuild_threshold_percent", &mRebuildThreshold)
+    );
+
+    mPluginSettings.push_back(
+        std::make_shared<BooleanSetting>("general", "disk_cache", &mDiskCache)
+    );
+
+    mPluginSettings.push_back(
+        std::make_shared<BooleanSetting>("general", "record_traces", &mRecordTraces)
+    );
+
     for (guint i = 0; i < mCustomColors.size(); i++) {
         std::string key = "order_" + std::to_string(i);
         mPluginSettings.push_back(
@@ -73,6 +73,24 @@
 
 
 
+// -----------------------------------------------------------------------------
+    struct IntegerSetting : public BracketColorsPluginSetting
+/*
+
+----------------------------------------------------------------------------- */
+{
+    IntegerSetting(
+        std::string group,
+        std::string key,
+        gpointer value
+    );
+
+    bool read(GKeyFile *kf);
+    bool write(GKeyFile *kf);
+};
+
+
+
 // -----------------------------------------------------------------------------
     struct ColorSetting : public BracketColorsPluginSetting
 /*
@@ -98,6 +116,12 @@
 ----------------------------------------------------------------------------- */
 {
     gboolean mUseDefaults;
+    gboolean mBackgroundAnalysis;
+    gint mParallelMinSize;
+    gint mMemoryBudget;
+    gint mRebuildThreshold;
+    gboolean mDiskCache;
+    gboolean mRecordTraces;
     BracketColorArray mColors;
     BracketColorArray mCustomColors;
 
@@ -0,0 +1,266 @@
+/*
+ *      DirtyRanges.cc
+ *
+ *      Copyright 2023 Asif Amin <asifamin@utexas.edu>
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+
+/* --------------------------------- INCLUDES ------------------------------- */
+
+#include <algorithm>
+
+#include "DirtyRanges.h"
+
+/* ------------------------------ IMPLEMENTATION ---------------------------- */
+
+
+// -----------------------------------------------------------------------------
+    DirtyRanges::DirtyRanges(gint mergeDistance)
+/*
+    Constructor
+----------------------------------------------------------------------------- */
+:   mMergeDistance(mergeDistance)
+{
+    // nothing to do
+}
+
+
+
+// -----------------------------------------------------------------------------
+    std::vector<DirtyRanges::Range>::iterator DirtyRanges::EndingAfter(
+        gint position
+    )
+/*
+
+----------------------------------------------------------------------------- */
+{
+    return std::upper_bound(
+        mRanges.begin(), mRanges.end(), position,
+        [](gint value, const Range &range) { return value < range.second; }
+    );
+}
+
+
+
+// -----------------------------------------------------------------------------
+    std::vector<DirtyRanges::Range>::const_iterator DirtyRanges::EndingAfter(
+        gint position
+    ) const
+/*
+
+----------------------------------------------------------------------------- */
+{
+    return std::upper_bound(
+        mRanges.begin(), mRanges.end(), position,
+        [](gint value, const Range &range) { return value < range.second; }
+    );
+}
+
+
+
+// -----------------------------------------------------------------------------
+    void DirtyRanges::Add(gint start, gint end)
+/*
+    mark [start, end) dirty, merging with nearby ranges
+----------------------------------------------------------------------------- */
+{
+    if (start >= end) {
+        return;
+    }
+
+    // every range ending at or after start - mMergeDistance may join in
+    auto first = EndingAfter(start - mMergeDistance - 1);
+    auto last = first;
+    while (last != mRanges.end() and last->first <= end + mMergeDistance) {
+        start = std::min(start, last->first);
+        end = std::max(end, last->second);
+        ++last;
+    }
+
+    if (first == last) {
+        mRanges.insert(first, Range(start, end));
+        return;
+    }
+
+    *first = Range(start, end);
+    mRanges.erase(first + 1, last);
+}
+
+
+
+// -----------------------------------------------------------------------------
+    void DirtyRanges::Remove(gint start, gint end)
+/*
+    mark [start, end) done, ranges sticking out on either side are kept
+----------------------------------------------------------------------------- */
+{
+    if (start >= end) {
+        return;
+    }
+
+    auto first = EndingAfter(start);
+    auto last = first;
+    while (last != mRanges.end() and last->first < end) {
+        ++last;
+    }
+
+    if (first == last) {
+        return;
+    }
+
+    Range head(first->first, start);
+    Range tail(end, (last - 1)->second);
+
+    first = mRanges.erase(first, last);
+
+    if (tail.first < tail.second) {
+        first = mRanges.insert(first, tail);
+    }
+    if (head.first < head.second) {
+        mRanges.insert(first, head);
+    }
+}
+
+
+
+// -----------------------------------------------------------------------------
+    gboolean DirtyRanges::Contains(gint position) const
+/*
+
+----------------------------------------------------------------------------- */
+{
+    auto it = EndingAfter(position);
+    return it != mRanges.end() and it->first <= position;
+}
+
+
+
+// -----------------------------------------------------------------------------
+    gsize DirtyRanges::Length() const
+/*
+
+----------------------------------------------------------------------------- */
+{
+    gsize length = 0;
+    for (const Range &range : mRanges) {
+        length += range.second - range.first;
+    }
+
+    return length;
+}
+
+
+
+// -----------------------------------------------------------------------------
+    gboolean DirtyRanges::First(gint start, gint end, Range &range) const
+/*
+
+----------------------------------------------------------------------------- */
+{
+    auto it = EndingAfter(start);
+    if (it == mRanges.end() or it->first >= end) {
+        return FALSE;
+    }
+
+    range = Range(std::max(it->first, start), std::min(it->second, end));
+    return TRUE;
+}
+
+
+
+// -----------------------------------------------------------------------------
+    void DirtyRanges::Shift(gint position, gint delta)
+/*
+    a range the insertion point falls inside of grows to cover the new
+    text, deleted text shrinks the ranges it overlaps
+----------------------------------------------------------------------------- */
+{
+    gint deleteStart = delta < 0 ? position + delta : position;
+
+    // an insertion right at the end of a range does not extend it
+    auto moveStart = [=](gint x) {
+        return x >= position ? x + delta : std::min(x, deleteStart);
+    };
+    auto moveEnd = [=](gint x) {
+        return x > position ? x + delta : std::min(x, deleteStart);
+    };
+
+    auto first = EndingAfter(deleteStart);
+    if (first == mRanges.end()) {
+        return;
+    }
+
+    // ranges stay sorted, empty ones are dropped and ones that now touch
+    // are joined. Gaps Remove() made are kept even if they are small.
+    auto out = first;
+    for (auto it = first; it != mRanges.end(); ++it) {
+
+        Range moved(moveStart(it->first), moveEnd(it->second));
+        if (moved.first >= moved.second) {
+            continue;
+        }
+
+        if (out != first and moved.first <= (out - 1)->second) {
+            (out - 1)->second = std::max((out - 1)->second, moved.second);
+            continue;
+        }
+
+        *out++ = moved;
+    }
+    mRanges.erase(out, mRanges.end());
+
+    // the first moved range may now reach the one before it
+    if (first != mRanges.begin() and first != mRanges.end()) {
+        auto previous = first - 1;
+        if (first->first <= previous->second) {
+            previous->second = std::max(previous->second, first->second);
+            mRanges.erase(first);
+        }
+    }
+}
+
+
+
+// -----------------------------------------------------------------------------
+    void DirtyRanges::Apply(const EditLog &editLog)
+/*
+    Shift() for every change of the log in one pass
+----------------------------------------------------------------------------- */
+{
+    if (editLog.Empty()) {
+        return;
+    }
+
+    auto out = mRanges.begin();
+    for (auto it = mRanges.begin(); it != mRanges.end(); it++) {
+        // ranges ending in replaced text take all of the replacement
+        Range moved;
+        editLog.MapForward(it->first, moved.first);
+        editLog.MapForward(it->second, moved.second, TRUE);
+        if (moved.first >= moved.second) {
+            continue;
+        }
+
+        if (out != mRanges.begin() and moved.first <= (out - 1)->second) {
+            (out - 1)->second = std::max((out - 1)->second, moved.second);
+            continue;
+        }
+
+        *out++ = moved;
+    }
+    mRanges.erase(out, mRanges.end());
+}
@@ -0,0 +1,86 @@
+/*
+ *      DirtyRanges.h
+ *
+ *      Copyright 2023 Asif Amin <asifamin@utexas.edu>
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+#ifndef __DIRTY_RANGES_H__
+#define __DIRTY_RANGES_H__
+
+/* --------------------------------- INCLUDES ------------------------------- */
+
+#include <utility>
+#include <vector>
+
+#include <glib.h>
+
+#include "EditLog.h"
+
+/* ----------------------------- CLASS DEFINITIONS -------------------------- */
+
+// -----------------------------------------------------------------------------
+    struct DirtyRanges
+/*
+    Purpose:    queue of document ranges that still need work
+
+    Ranges are kept sorted and disjoint in one vector. Adding a range merges
+    it with every range it overlaps or comes within mMergeDistance of, so
+    memory grows with the number of separate regions, not with the number
+    of brackets in them. Shift() follows text edits like BracketMap does.
+----------------------------------------------------------------------------- */
+{
+    // [start, end)
+    typedef std::pair<gint, gint> Range;
+
+    std::vector<Range> mRanges;
+    gint mMergeDistance;
+
+    DirtyRanges(gint mergeDistance = 0);
+
+    void Add(gint start, gint end);
+    void Add(gint position) { Add(position, position + 1); }
+    void Remove(gint start, gint end);
+    void Clear() { mRanges.clear(); }
+
+    gboolean Contains(gint position) const;
+
+    // first dirty part of [start, end), FALSE if there is none
+    gboolean First(gint start, gint end, Range &range) const;
+
+    /*
+     * Positions at or after position move by delta. When delta is negative
+     * [position + delta, position) was deleted and is cut out of the ranges.
+     */
+    void Shift(gint position, gint delta);
+
+    // Shift() for every change of a compacted log
+    void Apply(const EditLog &editLog);
+
+    gboolean Empty() const { return mRanges.empty(); }
+    gsize Size() const { return mRanges.size(); }
+
+    // number of dirty positions
+    gsize Length() const;
+    gsize MemoryUsage() const { return mRanges.capacity() * sizeof(Range); }
+
+private:
+    // first range which ends after position
+    std::vector<Range>::iterator EndingAfter(gint position);
+    std::vector<Range>::const_iterator EndingAfter(gint position) const;
+};
+
+#endif
@@ -0,0 +1,280 @@
+/*
+ *      EditLog.cc
+ *
+ *      Copyright 2023 Asif Amin <asifamin@utexas.edu>
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+/* --------------------------------- INCLUDES ------------------------------- */
+
+#include <algorithm>
+
+#include "EditLog.h"
+
+/* ------------------------------ IMPLEMENTATION ---------------------------- */
+
+
+// -----------------------------------------------------------------------------
+    EditLog::EditLog()
+/*
+    Constructor
+----------------------------------------------------------------------------- */
+:   mGapStart(0),
+    mGapEnd(0),
+    mShift(0),
+    mMoved(0)
+{
+    // nothing to do
+}
+
+
+
+// -----------------------------------------------------------------------------
+    void EditLog::Clear()
+/*
+
+----------------------------------------------------------------------------- */
+{
+    mChanges.clear();
+    mGapStart = mGapEnd = 0;
+    mShift = 0;
+    mMoved = 0;
+}
+
+
+
+// -----------------------------------------------------------------------------
+    void EditLog::MoveGap(gsize index)
+/*
+    move the gap so it starts at logical index
+----------------------------------------------------------------------------- */
+{
+    gsize gapLength = mGapEnd - mGapStart;
+
+    if (index < mGapStart) {
+        // entries [index, mGapStart) go after the gap
+        for (gsize i = mGapStart; i > index; i--) {
+            Change &change = mChanges[i - 1 + gapLength];
+            change = mChanges[i - 1];
+            change.current -= mShift;
+        }
+        mMoved += mGapStart - index;
+    }
+    else if (index > mGapStart) {
+        // entries after the gap up to index go before it
+        for (gsize i = mGapStart; i < index; i++) {
+            Change &change = mChanges[i];
+            change = mChanges[i + gapLength];
+            change.current += mShift;
+        }
+        mMoved += index - mGapStart;
+    }
+
+    mGapStart = index;
+    mGapEnd = index + gapLength;
+
+    // nothing after the gap, start counting shifts again
+    if (mGapEnd == mChanges.size()) {
+        mShift = 0;
+    }
+}
+
+
+
+// -----------------------------------------------------------------------------
+    void EditLog::GrowGap()
+/*
+    make room for more entries at the gap
+----------------------------------------------------------------------------- */
+{
+    gsize capacity = mChanges.size();
+    gsize newCapacity = std::max<gsize>(16, capacity * 2);
+    gsize grow = newCapacity - capacity;
+
+    mChanges.resize(newCapacity);
+    std::copy_backward(
+        mChanges.begin() + mGapEnd, mChanges.begin() + capacity,
+        mChanges.end()
+    );
+
+    mGapEnd += grow;
+}
+
+
+
+// -----------------------------------------------------------------------------
+    void EditLog::Compact()
+/*
+
+----------------------------------------------------------------------------- */
+{
+    MoveGap(Size());
+    mChanges.resize(mGapStart);
+    mGapEnd = mGapStart;
+}
+
+
+
+// -----------------------------------------------------------------------------
+    gsize EditLog::UpperBound(gint position) const
+/*
+
+----------------------------------------------------------------------------- */
+{
+    auto byCurrent = [](gint value, const Change &change) {
+        return value < change.current;
+    };
+
+    // the part before the gap holds absolute positions
+    auto beforeGap = mChanges.begin() + mGapStart;
+    auto it = std::upper_bound(mChanges.begin(), beforeGap, position, byCurrent);
+    if (it != beforeGap) {
+        return it - mChanges.begin();
+    }
+
+    auto afterGap = std::upper_bound(
+        mChanges.begin() + mGapEnd, mChanges.end(), position - mShift, byCurrent
+    );
+    return mGapStart + (afterGap - (mChanges.begin() + mGapEnd));
+}
+
+
+
+// -----------------------------------------------------------------------------
+    void EditLog::Insert(gint position, gint length)
+/*
+    length characters were inserted at position of the current text
+----------------------------------------------------------------------------- */
+{
+    if (length <= 0) {
+        return;
+    }
+
+    gsize next = UpperBound(position);
+    MoveGap(next);
+
+    // everything before the gap is absolute now
+    Change *previous = next > 0 ? &mChanges[next - 1] : NULL;
+
+    if (previous != NULL and position <= previous->current + previous->length) {
+        // inside or right after a replacement, it just gets longer
+        previous->length += length;
+    }
+    else {
+        gint delta = previous == NULL ?
+            0 : previous->current + previous->length - previous->end;
+        gint start = position - delta;
+
+        if (mGapStart == mGapEnd) {
+            GrowGap();
+        }
+        mChanges[mGapStart++] = { start, start, length, position };
+    }
+
+    if (mGapEnd < mChanges.size()) {
+        mShift += length;
+    }
+}
+
+
+
+// -----------------------------------------------------------------------------
+    void EditLog::Delete(gint position, gint length)
+/*
+    [position, position + length) of the current text was deleted
+----------------------------------------------------------------------------- */
+{
+    if (length <= 0) {
+        return;
+    }
+
+    gint end = position + length;
+
+    // replacements touching the deleted range are merged into one, the
+    // gap goes after them so they are all absolute
+    gsize last = UpperBound(end);
+    MoveGap(last);
+
+    gsize first = last;
+    while (first > 0 and mChanges[first - 1].current + mChanges[first - 1].length >= position) {
+        first--;
+    }
+
+    Change merged;
+
+    if (first == last) {
+        gint delta = first == 0 ?
+            0 : mChanges[first - 1].current + mChanges[first - 1].length - mChanges[first - 1].end;
+        merged = { position - delta, end - delta, 0, position };
+    }
+    else {
+        const Change &a = mChanges[first];
+        const Change &b = mChanges[last - 1];
+
+        gint currentStart = std::min(position, a.current);
+        gint currentEnd = std::max(end, b.current + b.length);
+
+        merged.start = std::min(a.start, position - (a.current - a.start));
+        merged.end = std::max(b.end, end - (b.current + b.length - b.end));
+        merged.length = currentEnd - currentStart - length;
+        merged.current = currentStart;
+    }
+
+    // merged entries are swallowed by the gap
+    mGapStart = first;
+
+    // typed and deleted again, nothing is left of it
+    if (merged.start != merged.end or merged.length != 0) {
+        if (mGapStart == mGapEnd) {
+            GrowGap();
+        }
+        mChanges[mGapStart++] = merged;
+    }
+
+    if (mGapEnd < mChanges.size()) {
+        mShift -= length;
+    }
+}
+
+
+
+// -----------------------------------------------------------------------------
+    gboolean EditLog::MapForward(
+        gint position,
+        gint &current,
+        gboolean after
+    ) const
+/*
+
+----------------------------------------------------------------------------- */
+{
+    // first change ending after position, insertions at position move it
+    auto change = std::upper_bound(
+        mChanges.begin(), mChanges.end(), position,
+        [](gint value, const Change &change) { return value < change.end; }
+    );
+
+    if (change != mChanges.end() and position >= change->start) {
+        current = after ? change->current + change->length : change->current;
+        return FALSE;
+    }
+
+    gint delta = change == mChanges.begin() ?
+        0 : (change - 1)->current + (change - 1)->length - (change - 1)->end;
+    current = position + delta;
+
+    return TRUE;
+}
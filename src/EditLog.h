@@ -0,0 +1,107 @@
+/*
+ *      EditLog.h
+ *
+ *      Copyright 2023 Asif Amin <asifamin@utexas.edu>
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+#ifndef __EDIT_LOG_H__
+#define __EDIT_LOG_H__
+
+/* --------------------------------- INCLUDES ------------------------------- */
+
+#include <vector>
+
+#include <glib.h>
+
+/* ----------------------------- CLASS DEFINITIONS -------------------------- */
+
+// -----------------------------------------------------------------------------
+    struct EditLog
+/*
+    Purpose:    text edits a bracket map has not caught up with yet
+
+    Edits are folded into one net change of the text as they arrive: a
+    sorted list of disjoint replacements, each saying which range of the
+    text before the log now holds how many characters. Edits touching a
+    replacement are merged into it, so typing, backspacing and replacing
+    one match after the other only grow a single entry or add one.
+
+    The list is a gap buffer like BracketMap, kept at the last edit. Current
+    positions after the gap are stored without mShift, so edits walking
+    forwards or backwards through the text cost O(1) each.
+
+    Positions map from the text before the log to the current text with a
+    binary search, and a bracket map catches up in one linear pass.
+----------------------------------------------------------------------------- */
+{
+    // [start, end) of the text before the log now holds length characters
+    // starting at current
+    struct Change {
+        gint start, end;
+        gint length;
+        gint current;
+    };
+
+    std::vector<Change> mChanges;
+
+    // physical [mGapStart, mGapEnd) is unused
+    gsize mGapStart, mGapEnd;
+    gint mShift;
+
+    // entries moved across the gap since the last Clear()
+    gsize mMoved;
+
+    EditLog();
+
+    void Insert(gint position, gint length);
+    void Delete(gint position, gint length);
+    void Clear();
+
+    // drop the gap, mChanges then holds every change in order. Must be
+    // called before reading mChanges or mapping positions.
+    void Compact();
+
+    /*
+     * Position in the text before the log mapped to the current text.
+     * Returns FALSE if it was replaced, current is then where the
+     * replacement starts, or where it ends when after is TRUE.
+     */
+    gboolean MapForward(gint position, gint &current, gboolean after = FALSE) const;
+
+    gboolean Empty() const { return Size() == 0; }
+    gboolean Full() const { return mMoved >= MAX_MOVED; }
+    gsize Size() const { return mChanges.size() - (mGapEnd - mGapStart); }
+
+    // edits jumping around the text move entries across the gap, the owner
+    // applies the log once that adds up
+    static const gsize MAX_MOVED = 1 << 20;
+
+private:
+    gint GetCurrent(gsize index) const {
+        return index < mGapStart ?
+            mChanges[index].current :
+            mChanges[index + (mGapEnd - mGapStart)].current + mShift;
+    }
+
+    // first change starting after position, Size() if none
+    gsize UpperBound(gint position) const;
+
+    void MoveGap(gsize index);
+    void GrowGap();
+};
+
+#endif
@@ -0,0 +1,191 @@
+/*
+ *      IndicatorPainter.cc
+ *
+ *      Copyright 2023 Asif Amin <asifamin@utexas.edu>
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+
+/* --------------------------------- INCLUDES ------------------------------- */
+
+#include <algorithm>
+
+#include "IndicatorPainter.h"
+#include "Metrics.h"
+
+/* ------------------------------ IMPLEMENTATION ---------------------------- */
+
+
+// -----------------------------------------------------------------------------
+    IndicatorPainter::IndicatorPainter(
+        guint firstIndicator,
+        guint numIndicators
+    )
+/*
+    Constructor
+----------------------------------------------------------------------------- */
+:   mFirstIndicator(firstIndicator),
+    mNumIndicators(numIndicators)
+{
+    // nothing to do
+}
+
+
+
+// -----------------------------------------------------------------------------
+    void IndicatorPainter::Paint(gint position, guint indicator)
+/*
+    position should only have indicator set
+----------------------------------------------------------------------------- */
+{
+    mPending.push_back(std::make_pair(position, static_cast<gint>(indicator)));
+}
+
+
+
+// -----------------------------------------------------------------------------
+    void IndicatorPainter::Clear(gint position)
+/*
+    position should have none of our indicators
+----------------------------------------------------------------------------- */
+{
+    mPending.push_back(std::make_pair(position, CLEAR));
+}
+
+
+
+// -----------------------------------------------------------------------------
+    void IndicatorPainter::ClearRange(
+        ScintillaObject *sci,
+        gint start, gint length
+    ) const
+/*
+
+----------------------------------------------------------------------------- */
+{
+    for (guint i = 0; i < mNumIndicators; i++) {
+        BC_METRICS_COUNT_MESSAGE(SCI_SETINDICATORCURRENT);
+        BC_METRICS_COUNT_MESSAGE(SCI_INDICATORCLEARRANGE);
+        scintilla_send_message(sci, SCI_SETINDICATORCURRENT, mFirstIndicator + i, 0);
+        scintilla_send_message(sci, SCI_INDICATORCLEARRANGE, start, length);
+    }
+}
+
+
+
+// -----------------------------------------------------------------------------
+    void IndicatorPainter::ClearInserted(
+        ScintillaObject *sci,
+        gint start, gint length
+    ) const
+/*
+    inserted text takes the indicators of the text it was inserted next to,
+    the same for all of it, so one query says which have to go
+----------------------------------------------------------------------------- */
+{
+    BC_METRICS_COUNT_MESSAGE(SCI_INDICATORALLONFOR);
+    guint32 current = scintilla_send_message(sci, SCI_INDICATORALLONFOR, start, 0);
+
+    for (guint i = 0; i < mNumIndicators; i++) {
+        if ((current >> (mFirstIndicator + i)) & 1) {
+            BC_METRICS_COUNT_MESSAGE(SCI_SETINDICATORCURRENT);
+            BC_METRICS_COUNT_MESSAGE(SCI_INDICATORCLEARRANGE);
+            scintilla_send_message(sci, SCI_SETINDICATORCURRENT, mFirstIndicator + i, 0);
+            scintilla_send_message(sci, SCI_INDICATORCLEARRANGE, start, length);
+        }
+    }
+}
+
+
+
+// -----------------------------------------------------------------------------
+    void IndicatorPainter::Flush(ScintillaObject *sci)
+/*
+    send everything recorded since the last flush
+----------------------------------------------------------------------------- */
+{
+    if (mPending.size() == 0) {
+        return;
+    }
+
+    // the last request for a position wins
+    std::stable_sort(
+        mPending.begin(), mPending.end(),
+        [](const std::pair<gint, gint> &a, const std::pair<gint, gint> &b) {
+            return a.first < b.first;
+        }
+    );
+
+    std::vector<std::vector<gint> > fills(mNumIndicators), clears(mNumIndicators);
+
+    for (gsize i = 0; i < mPending.size(); i++) {
+
+        if (i + 1 < mPending.size() and mPending[i + 1].first == mPending[i].first) {
+            continue;
+        }
+
+        gint position = mPending[i].first;
+        gint wanted = mPending[i].second;
+
+        BC_METRICS_COUNT_MESSAGE(SCI_INDICATORALLONFOR);
+        guint32 current = scintilla_send_message(
+            sci, SCI_INDICATORALLONFOR, position, 0
+        );
+
+        for (guint j = 0; j < mNumIndicators; j++) {
+            guint indicator = mFirstIndicator + j;
+            gboolean isSet = (current >> indicator) & 1;
+            gboolean wantSet = wanted == static_cast<gint>(indicator);
+
+            if (wantSet and not isSet) {
+                fills[j].push_back(position);
+            }
+            else if (isSet and not wantSet) {
+                clears[j].push_back(position);
+            }
+        }
+    }
+
+    mPending.clear();
+
+    /*
+     * Positions are sorted, so consecutive positions become one range
+     */
+
+    auto sendRuns = [sci](const std::vector<gint> &positions, guint message) {
+        gsize i = 0;
+        while (i < positions.size()) {
+            gsize j = i + 1;
+            while (j < positions.size() and positions[j] == positions[j - 1] + 1) {
+                j++;
+            }
+            BC_METRICS_COUNT_MESSAGE(message);
+            scintilla_send_message(sci, message, positions[i], j - i);
+            i = j;
+        }
+    };
+
+    for (guint j = 0; j < mNumIndicators; j++) {
+        if (clears[j].size() == 0 and fills[j].size() == 0) {
+            continue;
+        }
+
+        BC_METRICS_COUNT_MESSAGE(SCI_SETINDICATORCURRENT);
+        scintilla_send_message(sci, SCI_SETINDICATORCURRENT, mFirstIndicator + j, 0);
+        sendRuns(clears[j], SCI_INDICATORCLEARRANGE);
+        sendRuns(fills[j], SCI_INDICATORFILLRANGE);
+    }
+}
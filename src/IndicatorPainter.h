@@ -0,0 +1,69 @@
+/*
+ *      IndicatorPainter.h
+ *
+ *      Copyright 2023 Asif Amin <asifamin@utexas.edu>
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+#ifndef __INDICATOR_PAINTER_H__
+#define __INDICATOR_PAINTER_H__
+
+/* --------------------------------- INCLUDES ------------------------------- */
+
+#include <vector>
+#include <utility>
+
+#include <geanyplugin.h>
+
+/* ----------------------------- CLASS DEFINITIONS -------------------------- */
+
+// -----------------------------------------------------------------------------
+    struct IndicatorPainter
+/*
+    Purpose:    batch indicator changes for a range of indicators
+
+    Paint() and Clear() only record what a position should look like.
+    Flush() reads the current state of every position with one
+    SCI_INDICATORALLONFOR, then for each indicator sets it current once and
+    sends its clears and fills in position order, merging adjacent
+    positions into a single range.
+----------------------------------------------------------------------------- */
+{
+    guint mFirstIndicator, mNumIndicators;
+
+    // position and the indicator it should have, CLEAR for none
+    std::vector<std::pair<gint, gint> > mPending;
+
+    IndicatorPainter(guint firstIndicator, guint numIndicators);
+
+    void Paint(gint position, guint indicator);
+    void Clear(gint position);
+    void Flush(ScintillaObject *sci);
+
+    // immediately clear all of our indicators from [start, start + length)
+    void ClearRange(ScintillaObject *sci, gint start, gint length) const;
+
+    // same for text that was just inserted, usually nothing has to be sent
+    void ClearInserted(ScintillaObject *sci, gint start, gint length) const;
+
+    gsize MemoryUsage() const {
+        return mPending.capacity() * sizeof(mPending[0]);
+    }
+
+    static const gint CLEAR = -1;
+};
+
+#endif
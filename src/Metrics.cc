@@ -0,0 +1,254 @@
+/*
+ *      Metrics.cc
+ *
+ *      Copyright 2023 Asif Amin <asifamin@utexas.edu>
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+/* --------------------------------- INCLUDES ------------------------------- */
+
+#include <string.h>
+
+#include "Metrics.h"
+
+/* --------------------------------- CONSTANTS ------------------------------ */
+
+    static const gchar *sTimerNames[NUM_TIMERS] = {
+        "sci_notify",
+        "apply_edits",
+        "end_burst",
+        "recompute",
+        "render",
+        "analysis"
+    };
+
+    static const gchar *sCounterNames[NUM_COUNTERS] = {
+        "rebuild",
+        "restore",
+        "stale_indicator"
+    };
+
+    // messages we send, so the dump can name them
+    static const struct {
+        guint message;
+        const gchar *name;
+    } sMessageNames[] = {
+        { SCI_BRACEMATCH, "SCI_BRACEMATCH" },
+        { SCI_DOCLINEFROMVISIBLE, "SCI_DOCLINEFROMVISIBLE" },
+        { SCI_GETCHARACTERPOINTER, "SCI_GETCHARACTERPOINTER" },
+        { SCI_GETFIRSTVISIBLELINE, "SCI_GETFIRSTVISIBLELINE" },
+        { SCI_GETGAPPOSITION, "SCI_GETGAPPOSITION" },
+        { SCI_GETLENGTH, "SCI_GETLENGTH" },
+        { SCI_GETLEXER, "SCI_GETLEXER" },
+        { SCI_GETRANGEPOINTER, "SCI_GETRANGEPOINTER" },
+        { SCI_GETSTYLEAT, "SCI_GETSTYLEAT" },
+        { SCI_GETSTYLEDTEXT, "SCI_GETSTYLEDTEXT" },
+        { SCI_INDICATORALLONFOR, "SCI_INDICATORALLONFOR" },
+        { SCI_INDICATORCLEARRANGE, "SCI_INDICATORCLEARRANGE" },
+        { SCI_INDICATORFILLRANGE, "SCI_INDICATORFILLRANGE" },
+        { SCI_INDICATORVALUEAT, "SCI_INDICATORVALUEAT" },
+        { SCI_INDICSETFORE, "SCI_INDICSETFORE" },
+        { SCI_INDICSETSTYLE, "SCI_INDICSETSTYLE" },
+        { SCI_LINESONSCREEN, "SCI_LINESONSCREEN" },
+        { SCI_POSITIONFROMLINE, "SCI_POSITIONFROMLINE" },
+        { SCI_SETINDICATORCURRENT, "SCI_SETINDICATORCURRENT" },
+        { SCI_STYLEGETBACK, "SCI_STYLEGETBACK" }
+    };
+
+/* ---------------------------------- GLOBALS ------------------------------- */
+
+    Metrics gMetrics;
+
+/* ------------------------------ IMPLEMENTATION ---------------------------- */
+
+
+// -----------------------------------------------------------------------------
+    LatencyHistogram::LatencyHistogram()
+/*
+    Constructor
+----------------------------------------------------------------------------- */
+:   mCount(0),
+    mTotal(0),
+    mMax(0)
+{
+    memset(mBuckets, 0, sizeof(mBuckets));
+}
+
+
+
+// -----------------------------------------------------------------------------
+    guint64 LatencyHistogram::Percentile(
+        guint percent
+    ) const
+/*
+
+----------------------------------------------------------------------------- */
+{
+    if (mCount == 0) {
+        return 0;
+    }
+
+    guint64 wanted = (mCount * percent + 99) / 100;
+    guint64 seen = 0;
+
+    for (guint bucket = 0; bucket < NUM_BUCKETS; bucket++) {
+        seen += mBuckets[bucket];
+        if (seen >= wanted) {
+            return MIN((G_GUINT64_CONSTANT(2) << bucket) - 1, mMax);
+        }
+    }
+
+    return mMax;
+}
+
+
+
+// -----------------------------------------------------------------------------
+    Metrics::Metrics()
+/*
+    Constructor
+----------------------------------------------------------------------------- */
+{
+    Reset();
+}
+
+
+
+// -----------------------------------------------------------------------------
+    void Metrics::Reset()
+/*
+
+----------------------------------------------------------------------------- */
+{
+    for (LatencyHistogram &timer : mTimers) {
+        timer = LatencyHistogram();
+    }
+
+    memset(mCounters, 0, sizeof(mCounters));
+    memset(mMessages, 0, sizeof(mMessages));
+    mOtherMessages = 0;
+    mStartTime = g_get_monotonic_time();
+}
+
+
+
+// -----------------------------------------------------------------------------
+    gboolean Metrics::Dump(
+        const std::string &filename
+    ) const
+/*
+    write a readable snapshot, times are in microseconds
+----------------------------------------------------------------------------- */
+{
+    GString *out = g_string_new(NULL);
+
+    g_string_append_printf(
+        out, "# bracketcolors metrics over %.1f s\n\n",
+        (g_get_monotonic_time() - mStartTime) / 1e6
+    );
+
+    g_string_append_printf(
+        out, "%-12s %10s %10s %10s %10s %10s %10s %12s\n",
+        "timer", "count", "mean", "p50", "p90", "p99", "max", "total ms"
+    );
+
+    for (guint i = 0; i < NUM_TIMERS; i++) {
+        const LatencyHistogram &timer = mTimers[i];
+        g_string_append_printf(
+            out, "%-12s %10" G_GUINT64_FORMAT " %10.1f %10.1f %10.1f %10.1f %10.1f %12.1f\n",
+            sTimerNames[i], timer.mCount,
+            timer.mCount ? timer.mTotal / 1e3 / timer.mCount : 0.0,
+            timer.Percentile(50) / 1e3,
+            timer.Percentile(90) / 1e3,
+            timer.Percentile(99) / 1e3,
+            timer.mMax / 1e3,
+            timer.mTotal / 1e6
+        );
+    }
+
+    g_string_append_printf(out, "\n%-26s %12s\n", "event", "count");
+
+    for (guint i = 0; i < NUM_COUNTERS; i++) {
+        g_string_append_printf(out, "%-26s %12" G_GUINT64_FORMAT "\n", sCounterNames[i], mCounters[i]);
+    }
+
+    g_string_append_printf(out, "\n%-26s %12s\n", "message", "count");
+
+    for (guint i = 0; i < NUM_MESSAGES; i++) {
+        if (mMessages[i] == 0) {
+            continue;
+        }
+
+        guint message = FIRST_MESSAGE + i;
+        const gchar *name = NULL;
+        for (const auto &entry : sMessageNames) {
+            if (entry.message == message) {
+                name = entry.name;
+            }
+        }
+
+        if (name != NULL) {
+            g_string_append_printf(out, "%-26s %12" G_GUINT64_FORMAT "\n", name, mMessages[i]);
+        }
+        else {
+            g_string_append_printf(out, "%-26u %12" G_GUINT64_FORMAT "\n", message, mMessages[i]);
+        }
+    }
+
+    if (mOtherMessages > 0) {
+        g_string_append_printf(out, "%-26s %12" G_GUINT64_FORMAT "\n", "other", mOtherMessages);
+    }
+
+    GError *error = NULL;
+    gboolean success = g_file_set_contents(filename.c_str(), out->str, out->len, &error);
+    if (not success) {
+        g_warning("Failed to write metrics: %s", error->message);
+        g_error_free(error);
+    }
+
+    g_string_free(out, TRUE);
+
+    return success;
+}
+
+
+
+// -----------------------------------------------------------------------------
+    MetricsScope::MetricsScope(
+        MetricsTimer timer
+    )
+/*
+    Constructor
+----------------------------------------------------------------------------- */
+:   mTimer(timer),
+    mStart(Clock::now())
+{
+    // nothing to do
+}
+
+
+
+// -----------------------------------------------------------------------------
+    MetricsScope::~MetricsScope()
+/*
+    Destructor
+----------------------------------------------------------------------------- */
+{
+    auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        Clock::now() - mStart
+    );
+    gMetrics.mTimers[mTimer].Add(elapsed.count());
+}
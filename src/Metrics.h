@@ -0,0 +1,150 @@
+/*
+ *      Metrics.h
+ *
+ *      Copyright 2023 Asif Amin <asifamin@utexas.edu>
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+#ifndef __METRICS_H__
+#define __METRICS_H__
+
+/* --------------------------------- INCLUDES ------------------------------- */
+
+#include <chrono>
+#include <string>
+
+#include <geanyplugin.h>
+
+/* ----------------------------------- TYPES -------------------------------- */
+
+    // hot paths with their own latency histogram
+    enum MetricsTimer {
+        TIMER_SCI_NOTIFY = 0,
+        TIMER_APPLY_EDITS,
+        TIMER_END_BURST,
+        TIMER_RECOMPUTE,
+        TIMER_RENDER,
+        TIMER_ANALYSIS,
+        NUM_TIMERS
+    };
+
+    // events that are counted, not timed
+    enum MetricsCounter {
+        COUNTER_REBUILD = 0,
+        COUNTER_RESTORE,
+        COUNTER_STALE_INDICATOR,
+        NUM_COUNTERS
+    };
+
+/* ----------------------------- CLASS DEFINITIONS -------------------------- */
+
+// -----------------------------------------------------------------------------
+    struct LatencyHistogram
+/*
+    Purpose:    distribution of durations in power of two buckets
+
+    Bucket i counts durations in [2^i, 2^(i+1)) nanoseconds, so adding a
+    sample is a bit scan and an increment.
+----------------------------------------------------------------------------- */
+{
+    static const guint NUM_BUCKETS = 40;
+
+    guint64 mBuckets[NUM_BUCKETS];
+    guint64 mCount, mTotal, mMax;
+
+    LatencyHistogram();
+
+    void Add(guint64 nanoseconds) {
+        guint bucket = nanoseconds > 1 ? 63 - __builtin_clzll(nanoseconds) : 0;
+        mBuckets[MIN(bucket, NUM_BUCKETS - 1)]++;
+        mCount++;
+        mTotal += nanoseconds;
+        mMax = MAX(mMax, nanoseconds);
+    }
+
+    // upper end of the bucket holding the given percentile
+    guint64 Percentile(guint percent) const;
+};
+
+
+
+// -----------------------------------------------------------------------------
+    struct Metrics
+/*
+    Purpose:    latency histograms, event and Scintilla message counts
+
+    Only touched from the main thread. Everything is a fixed size array, so
+    recording never allocates and is cheap enough to leave on.
+----------------------------------------------------------------------------- */
+{
+    static const guint FIRST_MESSAGE = 2000;
+    static const guint NUM_MESSAGES = 4096;
+
+    LatencyHistogram mTimers[NUM_TIMERS];
+    guint64 mCounters[NUM_COUNTERS];
+    guint64 mMessages[NUM_MESSAGES];
+    guint64 mOtherMessages;
+    gint64 mStartTime;
+
+    Metrics();
+
+    void CountMessage(guint message) {
+        if (message - FIRST_MESSAGE < NUM_MESSAGES) {
+            mMessages[message - FIRST_MESSAGE]++;
+        }
+        else {
+            mOtherMessages++;
+        }
+    }
+
+    void Reset();
+    gboolean Dump(const std::string &filename) const;
+};
+
+
+
+// -----------------------------------------------------------------------------
+    struct MetricsScope
+/*
+    Purpose:    adds the lifetime of the enclosing scope to a histogram
+----------------------------------------------------------------------------- */
+{
+    typedef std::chrono::steady_clock Clock;
+
+    MetricsTimer mTimer;
+    Clock::time_point mStart;
+
+    MetricsScope(MetricsTimer timer);
+    ~MetricsScope();
+};
+
+/* ---------------------------------- GLOBALS ------------------------------- */
+
+    extern Metrics gMetrics;
+
+/* ---------------------------------- MACROS -------------------------------- */
+
+#ifdef BC_ENABLE_METRICS
+# define BC_METRICS_SCOPE(timer) MetricsScope metricsScope(timer)
+# define BC_METRICS_COUNT_MESSAGE(message) gMetrics.CountMessage(message)
+# define BC_METRICS_COUNT(counter) gMetrics.mCounters[counter]++
+#else
+# define BC_METRICS_SCOPE(timer) ((void) 0)
+# define BC_METRICS_COUNT_MESSAGE(message) ((void) 0)
+# define BC_METRICS_COUNT(counter) ((void) 0)
+#endif
+
+#endif
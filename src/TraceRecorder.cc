@@ -0,0 +1,429 @@
+/*
+ *      TraceRecorder.cc
+ *
+ *      Copyright 2023 Asif Amin <asifamin@utexas.edu>
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+/* --------------------------------- INCLUDES ------------------------------- */
+
+#include <errno.h>
+#include <string.h>
+
+#include <glib/gstdio.h>
+
+#include "TraceRecorder.h"
+#include "Varint.h"
+
+/* --------------------------------- CONSTANTS ------------------------------ */
+
+    static const gchar sTraceMagic[4] = { 'B', 'C', 'T', 'R' };
+
+/* ------------------------------ IMPLEMENTATION ---------------------------- */
+
+
+// -----------------------------------------------------------------------------
+    TraceRecorder::TraceRecorder()
+/*
+    Constructor
+----------------------------------------------------------------------------- */
+:   mFile(NULL),
+    mLastTime(0)
+{
+    // nothing to do
+}
+
+
+
+// -----------------------------------------------------------------------------
+    TraceRecorder::~TraceRecorder()
+/*
+    Destructor
+----------------------------------------------------------------------------- */
+{
+    Close();
+}
+
+
+
+// -----------------------------------------------------------------------------
+    gboolean TraceRecorder::Open(
+        const std::string &filename
+    )
+/*
+    start a new trace, RecordDocument() has to come first
+----------------------------------------------------------------------------- */
+{
+    Close();
+
+    mFile = g_fopen(filename.c_str(), "wb");
+    if (mFile == NULL) {
+        g_warning("Failed to open trace \"%s\": %s", filename.c_str(), g_strerror(errno));
+        return FALSE;
+    }
+
+    mBuffer.assign(sTraceMagic, sTraceMagic + sizeof(sTraceMagic));
+    put_varint(mBuffer, VERSION);
+
+    return TRUE;
+}
+
+
+
+// -----------------------------------------------------------------------------
+    void TraceRecorder::Close()
+/*
+
+----------------------------------------------------------------------------- */
+{
+    if (mFile == NULL) {
+        return;
+    }
+
+    Flush();
+    fclose(mFile);
+    mFile = NULL;
+
+    std::vector<guint8>().swap(mBuffer);
+}
+
+
+
+// -----------------------------------------------------------------------------
+    void TraceRecorder::Flush()
+/*
+
+----------------------------------------------------------------------------- */
+{
+    if (not mBuffer.empty()) {
+        fwrite(mBuffer.data(), 1, mBuffer.size(), mFile);
+        mBuffer.clear();
+    }
+}
+
+
+
+// -----------------------------------------------------------------------------
+    void TraceRecorder::BeginEvent(
+        guint8 type
+    )
+/*
+    record type and the time since the previous record
+----------------------------------------------------------------------------- */
+{
+    if (mBuffer.size() >= FLUSH_SIZE) {
+        Flush();
+    }
+
+    gint64 now = g_get_monotonic_time();
+
+    mBuffer.push_back(type);
+    put_varint(mBuffer, now - mLastTime);
+
+    mLastTime = now;
+}
+
+
+
+// -----------------------------------------------------------------------------
+    void TraceRecorder::RecordDocument(
+        const gchar *text,
+        const guint8 *styles,
+        gint length,
+        const CodeStyleSet &codeStyles,
+        const gboolean enabled[BracketType::COUNT]
+    )
+/*
+
+----------------------------------------------------------------------------- */
+{
+    if (mFile == NULL) {
+        return;
+    }
+
+    mLastTime = g_get_monotonic_time();
+    BeginEvent(TraceEvent::DOCUMENT);
+
+    guint8 styleBits[256 / 8] = { 0 };
+    for (guint style = 0; style < 256; style++) {
+        if (codeStyles.test(style)) {
+            styleBits[style / 8] |= 1 << (style % 8);
+        }
+    }
+    mBuffer.insert(mBuffer.end(), styleBits, styleBits + sizeof(styleBits));
+
+    guint enabledTypes = 0;
+    for (guint i = 0; i < BracketType::COUNT; i++) {
+        if (enabled[i]) {
+            enabledTypes |= 1 << i;
+        }
+    }
+    put_varint(mBuffer, enabledTypes);
+
+    put_varint(mBuffer, length);
+    mBuffer.insert(mBuffer.end(), text, text + length);
+    mBuffer.insert(mBuffer.end(), styles, styles + length);
+}
+
+
+
+// -----------------------------------------------------------------------------
+    void TraceRecorder::RecordInsert(
+        gint position,
+        const gchar *text,
+        gint length
+    )
+/*
+
+----------------------------------------------------------------------------- */
+{
+    if (mFile == NULL) {
+        return;
+    }
+
+    BeginEvent(TraceEvent::INSERT);
+    put_varint(mBuffer, position);
+    put_varint(mBuffer, length);
+    mBuffer.insert(mBuffer.end(), text, text + length);
+}
+
+
+
+// -----------------------------------------------------------------------------
+    void TraceRecorder::RecordDelete(
+        gint position,
+        gint length
+    )
+/*
+
+----------------------------------------------------------------------------- */
+{
+    if (mFile == NULL) {
+        return;
+    }
+
+    BeginEvent(TraceEvent::DELETE);
+    put_varint(mBuffer, position);
+    put_varint(mBuffer, length);
+}
+
+
+
+// -----------------------------------------------------------------------------
+    void TraceRecorder::RecordStyle(
+        gint position,
+        const guint8 *styles,
+        gint length
+    )
+/*
+    styles of [position, position + length) after a restyle
+----------------------------------------------------------------------------- */
+{
+    if (mFile == NULL) {
+        return;
+    }
+
+    BeginEvent(TraceEvent::STYLE);
+    put_varint(mBuffer, position);
+    put_varint(mBuffer, length);
+    mBuffer.insert(mBuffer.end(), styles, styles + length);
+}
+
+
+
+// -----------------------------------------------------------------------------
+    TraceReader::TraceReader()
+/*
+    Constructor
+----------------------------------------------------------------------------- */
+:   mCursor(NULL),
+    mEnd(NULL),
+    mTime(0)
+{
+    // nothing to do
+}
+
+
+
+// -----------------------------------------------------------------------------
+    gboolean TraceReader::Open(
+        const std::string &filename
+    )
+/*
+
+----------------------------------------------------------------------------- */
+{
+    gchar *contents;
+    gsize length;
+
+    GError *error = NULL;
+    if (!g_file_get_contents(filename.c_str(), &contents, &length, &error)) {
+        g_warning("Failed to read trace: %s", error->message);
+        g_error_free(error);
+        return FALSE;
+    }
+
+    mData.assign(contents, contents + length);
+    g_free(contents);
+
+    mCursor = mData.data();
+    mEnd = mCursor + mData.size();
+    mTime = 0;
+
+    guint64 version;
+    if (
+        mData.size() < sizeof(sTraceMagic) or
+        memcmp(mCursor, sTraceMagic, sizeof(sTraceMagic)) != 0
+    ) {
+        g_warning("\"%s\" is not a bracket colors trace", filename.c_str());
+        return FALSE;
+    }
+
+    mCursor += sizeof(sTraceMagic);
+    if (not get_varint(mCursor, mEnd, version) or version != TraceRecorder::VERSION) {
+        g_warning("Unsupported trace version in \"%s\"", filename.c_str());
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+
+
+// -----------------------------------------------------------------------------
+    static gboolean read_bytes(
+        const guint8 *&cursor,
+        const guint8 *end,
+        guint64 length,
+        const guint8 *&bytes
+    )
+/*
+
+----------------------------------------------------------------------------- */
+{
+    if (guint64(end - cursor) < length) {
+        return FALSE;
+    }
+
+    bytes = cursor;
+    cursor += length;
+
+    return TRUE;
+}
+
+
+
+// -----------------------------------------------------------------------------
+    gboolean TraceReader::Next(
+        TraceEvent &event
+    )
+/*
+
+----------------------------------------------------------------------------- */
+{
+    if (mCursor == mEnd) {
+        return FALSE;
+    }
+
+    event.type = *mCursor++;
+
+    guint64 delay, position = 0, length = 0;
+    if (not get_varint(mCursor, mEnd, delay)) {
+        return FALSE;
+    }
+
+    mTime = event.type == TraceEvent::DOCUMENT ? 0 : mTime + delay;
+    event.time = mTime;
+
+    const guint8 *bytes;
+
+    switch (event.type) {
+
+        case TraceEvent::DOCUMENT: {
+            guint64 enabledTypes;
+            if (not read_bytes(mCursor, mEnd, 256 / 8, bytes)) {
+                return FALSE;
+            }
+
+            event.codeStyles.reset();
+            for (guint style = 0; style < 256; style++) {
+                if (bytes[style / 8] & (1 << (style % 8))) {
+                    event.codeStyles.set(style);
+                }
+            }
+
+            if (not get_varint(mCursor, mEnd, enabledTypes)) {
+                return FALSE;
+            }
+            for (guint i = 0; i < BracketType::COUNT; i++) {
+                event.enabled[i] = (enabledTypes >> i) & 1;
+            }
+
+            if (
+                not get_varint(mCursor, mEnd, length) or
+                not read_bytes(mCursor, mEnd, length, bytes)
+            ) {
+                return FALSE;
+            }
+            event.text.assign(reinterpret_cast<const gchar *>(bytes), length);
+
+            if (not read_bytes(mCursor, mEnd, length, bytes)) {
+                return FALSE;
+            }
+            event.styles.assign(bytes, bytes + length);
+
+            break;
+        }
+
+        case TraceEvent::INSERT:
+        case TraceEvent::DELETE:
+        case TraceEvent::STYLE: {
+            if (
+                not get_varint(mCursor, mEnd, position) or
+                not get_varint(mCursor, mEnd, length)
+            ) {
+                return FALSE;
+            }
+
+            event.text.clear();
+            event.styles.clear();
+
+            if (event.type == TraceEvent::INSERT) {
+                if (not read_bytes(mCursor, mEnd, length, bytes)) {
+                    return FALSE;
+                }
+                event.text.assign(reinterpret_cast<const gchar *>(bytes), length);
+            }
+            else if (event.type == TraceEvent::STYLE) {
+                if (not read_bytes(mCursor, mEnd, length, bytes)) {
+                    return FALSE;
+                }
+                event.styles.assign(bytes, bytes + length);
+            }
+
+            break;
+        }
+
+        default:
+            g_warning("Unknown trace record '%c'", event.type);
+            return FALSE;
+    }
+
+    event.position = position;
+    event.length = length;
+
+    return TRUE;
+}
@@ -0,0 +1,124 @@
+/*
+ *      TraceRecorder.h
+ *
+ *      Copyright 2023 Asif Amin <asifamin@utexas.edu>
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+#ifndef __TRACE_RECORDER_H__
+#define __TRACE_RECORDER_H__
+
+/* --------------------------------- INCLUDES ------------------------------- */
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include <glib.h>
+
+#include "BracketMatcher.h"
+
+/* ----------------------------------- TYPES -------------------------------- */
+
+    // one record of a trace, fields not used by a type are left empty
+    struct TraceEvent {
+
+        enum Type {
+            DOCUMENT = 'D',
+            INSERT = 'I',
+            DELETE = 'X',
+            STYLE = 'S'
+        };
+
+        guint8 type;
+
+        // microseconds since the document record
+        gint64 time;
+
+        gint position, length;
+        std::string text;
+        std::vector<guint8> styles;
+
+        // DOCUMENT only
+        CodeStyleSet codeStyles;
+        gboolean enabled[BracketType::COUNT];
+    };
+
+/* ----------------------------- CLASS DEFINITIONS -------------------------- */
+
+// -----------------------------------------------------------------------------
+    struct TraceRecorder
+/*
+    Purpose:    write the modifications of a document to a trace file
+
+    A trace starts with the whole document, its styles and the settings the
+    brackets depend on, followed by every insertion, deletion and restyle.
+    Numbers are varints, so a typed character takes about five bytes.
+    Records are buffered and written out in large blocks.
+----------------------------------------------------------------------------- */
+{
+    FILE *mFile;
+    gint64 mLastTime;
+    std::vector<guint8> mBuffer;
+
+    TraceRecorder();
+    ~TraceRecorder();
+
+    TraceRecorder(const TraceRecorder &) = delete;
+    TraceRecorder& operator=(const TraceRecorder &) = delete;
+
+    gboolean Open(const std::string &filename);
+    void Close();
+    gboolean IsOpen() const { return mFile != NULL; }
+
+    void RecordDocument(
+        const gchar *text, const guint8 *styles, gint length,
+        const CodeStyleSet &codeStyles,
+        const gboolean enabled[BracketType::COUNT]
+    );
+    void RecordInsert(gint position, const gchar *text, gint length);
+    void RecordDelete(gint position, gint length);
+    void RecordStyle(gint position, const guint8 *styles, gint length);
+
+    static const guint32 VERSION = 1;
+    static const gsize FLUSH_SIZE = 64 * 1024;
+
+private:
+    void BeginEvent(guint8 type);
+    void Flush();
+};
+
+
+
+// -----------------------------------------------------------------------------
+    struct TraceReader
+/*
+    Purpose:    read back what TraceRecorder wrote
+----------------------------------------------------------------------------- */
+{
+    std::vector<guint8> mData;
+    const guint8 *mCursor, *mEnd;
+    gint64 mTime;
+
+    TraceReader();
+
+    gboolean Open(const std::string &filename);
+
+    // FALSE at the end of the trace or if it is cut off
+    gboolean Next(TraceEvent &event);
+};
+
+#endif
@@ -0,0 +1,73 @@
+/*
+ *      Varint.h
+ *
+ *      Copyright 2023 Asif Amin <asifamin@utexas.edu>
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+#ifndef __VARINT_H__
+#define __VARINT_H__
+
+/* --------------------------------- INCLUDES ------------------------------- */
+
+#include <vector>
+
+#include <glib.h>
+
+/* --------------------------------- PROTOTYPES ----------------------------- */
+
+    /*
+     * Seven bits per byte, high bit set on all but the last. Used by the
+     * compact formats of BracketMap and TraceRecorder.
+     */
+
+    inline void put_varint(std::vector<guint8> &blob, guint64 value)
+    {
+        while (value >= 0x80) {
+            blob.push_back(guint8(value) | 0x80);
+            value >>= 7;
+        }
+        blob.push_back(guint8(value));
+    }
+
+    inline bool get_varint(const guint8 *&data, const guint8 *end, guint64 &value)
+    {
+        value = 0;
+        for (guint shift = 0; shift < 64; shift += 7) {
+            if (data == end) {
+                return false;
+            }
+            guint8 byte = *data++;
+            value |= guint64(byte & 0x7f) << shift;
+            if ((byte & 0x80) == 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // small magnitudes of either sign take few bytes
+    inline guint32 zigzag_encode(gint32 value)
+    {
+        return guint32(value) << 1 ^ guint32(value >> 31);
+    }
+
+    inline gint32 zigzag_decode(guint32 value)
+    {
+        return gint32(value >> 1) ^ -gint32(value & 1);
+    }
+
+#endif
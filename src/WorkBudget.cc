@@ -0,0 +1,64 @@
+/*
+ *      WorkBudget.cc
+ *
+ *      Copyright 2023 Asif Amin <asifamin@utexas.edu>
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+
+/* --------------------------------- INCLUDES ------------------------------- */
+
+#include "WorkBudget.h"
+
+/* ------------------------------ IMPLEMENTATION ---------------------------- */
+
+
+// -----------------------------------------------------------------------------
+    WorkBudget::WorkBudget(
+        gint64 budget
+    )
+/*
+    Constructor
+----------------------------------------------------------------------------- */
+:   mDeadline(budget < 0 ? G_MAXINT64 : g_get_monotonic_time() + budget),
+    mNumChecks(0),
+    mYieldedToInput(FALSE)
+{
+    // nothing to do
+}
+
+
+
+// -----------------------------------------------------------------------------
+    gboolean WorkBudget::Expired()
+/*
+    TRUE once the deadline has passed or input is waiting to be handled
+----------------------------------------------------------------------------- */
+{
+    if (mDeadline == G_MAXINT64) {
+        return FALSE;
+    }
+
+    if (mYieldedToInput or g_get_monotonic_time() >= mDeadline) {
+        return TRUE;
+    }
+
+    if (++mNumChecks % INPUT_CHECK_INTERVAL == 0 and gtk_events_pending()) {
+        mYieldedToInput = TRUE;
+    }
+
+    return mYieldedToInput;
+}
@@ -0,0 +1,56 @@
+/*
+ *      WorkBudget.h
+ *
+ *      Copyright 2023 Asif Amin <asifamin@utexas.edu>
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+#ifndef __WORK_BUDGET_H__
+#define __WORK_BUDGET_H__
+
+/* --------------------------------- INCLUDES ------------------------------- */
+
+#include <geanyplugin.h>
+
+/* ----------------------------- CLASS DEFINITIONS -------------------------- */
+
+// -----------------------------------------------------------------------------
+    struct WorkBudget
+/*
+    Purpose:    time limit for one tick of incremental work
+
+    Work loops call Expired() between units of work. The budget runs out
+    once the monotonic clock passes the deadline, or early when GTK has
+    input events waiting so typing and scrolling are never held up.
+----------------------------------------------------------------------------- */
+{
+    gint64 mDeadline;
+    guint mNumChecks;
+    gboolean mYieldedToInput;
+
+    // budget in microseconds, UNLIMITED never expires
+    WorkBudget(gint64 budget);
+
+    gboolean Expired();
+    gboolean YieldedToInput() const { return mYieldedToInput; }
+
+    static const gint64 UNLIMITED = -1;
+
+    // gtk_events_pending() is much more expensive than reading the clock
+    static const guint INPUT_CHECK_INTERVAL = 8;
+};
+
+#endif
@@ -0,0 +1,587 @@
+/*
+ *      BracketBench.cc
+ *
+ *      Copyright 2023 Asif Amin <asifamin@utexas.edu>
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+/*
+ * Benchmark of the bracket engine on synthetic documents, runs without
+ * geany or a display:
+ *
+ *      make bracketcolors_bench && ./src/bracketcolors_bench [max exponent]
+ *
+ * Every operation is an edit followed by the recompute pass the plugin would
+ * run for it. Allocations are counted by replacing the global operator new.
+ *
+ * Before timing anything, matching random documents in chunks and joining
+ * them with BracketMatcher::Combine() is checked against a single pass.
+ */
+
+/* --------------------------------- INCLUDES ------------------------------- */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <random>
+#include <vector>
+
+#include <glib.h>
+
+#include "BracketEdits.h"
+#include "BracketMap.h"
+#include "BracketMatcher.h"
+#include "DirtyRanges.h"
+
+/* --------------------------------- CONSTANTS ------------------------------ */
+
+    // new text of a paste, with a bracket pair every sPasteBracketDistance
+    static const gint sPasteLength = 256;
+    static const gint sPasteBracketDistance = 16;
+
+    // typed brackets enclose this much of the following text
+    static const gint sTypedBracketLength = 200;
+
+    // documents matched both in chunks and in one pass, and their size
+    static const gint sNumMatcherChecks = 2000;
+    static const gint sMatcherCheckLength = 4000;
+
+/* ----------------------------------- TYPES -------------------------------- */
+
+    struct Document {
+
+        /*
+         * Plugin state for one synthetic document
+         */
+
+        BracketMap bracketMap;
+        DirtyRanges recomputeRanges;
+        std::vector<BracketMap::Index> updatedBrackets;
+
+        gint length;
+        gint cursor;
+        std::mt19937 random;
+
+        Document() : length(0), cursor(0), random(42) {}
+    };
+
+    enum Operation {
+        TYPE_CHAR = 0,
+        DELETE_CHAR,
+        PASTE,
+        TYPE_BRACKET,
+        MIXED,
+        NUM_OPERATIONS
+    };
+
+    static const gchar *sOperationNames[NUM_OPERATIONS] = {
+        "type char", "delete char", "paste", "type bracket", "mixed"
+    };
+
+/* ---------------------------------- GLOBALS ------------------------------- */
+
+    static gsize gNumAllocations = 0;
+
+/* ------------------------------ IMPLEMENTATION ---------------------------- */
+
+
+void* operator new(std::size_t size)
+{
+    gNumAllocations++;
+    if (void *p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete[](void *p) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void *p, std::size_t) noexcept { std::free(p); }
+
+
+
+// -----------------------------------------------------------------------------
+    static void make_document(
+        Document &document,
+        gsize numBrackets
+    )
+/*
+    random but properly nested source, a few characters between brackets
+----------------------------------------------------------------------------- */
+{
+    std::vector<BracketMap::Entry> brackets;
+    brackets.reserve(numBrackets);
+
+    // indices into brackets of the still open ones
+    std::vector<gsize> open;
+    gint position = 0;
+
+    std::uniform_int_distribution<gint> gap(1, 16);
+    std::uniform_int_distribution<gint> coin(0, 99);
+
+    while (brackets.size() < numBrackets or not open.empty()) {
+        position += gap(document.random);
+
+        gboolean opens =
+            brackets.size() < numBrackets and
+            (open.empty() or (open.size() < 32 and coin(document.random) < 50));
+
+        if (opens) {
+            open.push_back(brackets.size());
+            brackets.push_back({
+                position, BracketMap::UNDEFINED,
+                static_cast<BracketMap::Type>(coin(document.random) % 3)
+            });
+        }
+        else {
+            BracketMap::Entry &entry = brackets[open.back()];
+            entry.length = position - entry.position;
+            open.pop_back();
+        }
+    }
+
+    document.length = position + 1;
+    document.cursor = document.length / 2;
+
+    document.bracketMap.Assign(brackets);
+    document.bracketMap.ComputeOrder(document.updatedBrackets);
+    document.updatedBrackets.clear();
+}
+
+
+
+// -----------------------------------------------------------------------------
+    static void recompute(
+        Document &document
+    )
+/*
+    what the recompute timer does for queued ranges, without a document to
+    match brackets in every queued bracket keeps its partner
+----------------------------------------------------------------------------- */
+{
+    BracketMap &bracketMap = document.bracketMap;
+
+    DirtyRanges::Range range;
+    while (document.recomputeRanges.First(0, G_MAXINT, range)) {
+        for (
+            gsize index = bracketMap.LowerBound(range.first);
+            index < bracketMap.Size() and bracketMap.GetPosition(index) < range.second;
+            index++
+        )
+        {
+            bracketMap.Update(
+                bracketMap.GetPosition(index),
+                bracketMap.GetType(index),
+                bracketMap.GetLength(index)
+            );
+        }
+        document.recomputeRanges.Remove(range.first, range.second);
+    }
+
+    document.updatedBrackets.clear();
+    bracketMap.ComputeOrder(document.updatedBrackets);
+}
+
+
+
+// -----------------------------------------------------------------------------
+    static void insert_text(
+        Document &document,
+        gint position,
+        gint length
+    )
+/*
+    same bookkeeping as on_sci_notify() for SC_MOD_INSERTTEXT
+----------------------------------------------------------------------------- */
+{
+    document.recomputeRanges.Shift(position, length);
+    document.recomputeRanges.Add(position, position + length);
+    bracket_edit_insert(
+        document.bracketMap, document.recomputeRanges,
+        position, length
+    );
+    document.length += length;
+}
+
+
+
+// -----------------------------------------------------------------------------
+    static void delete_text(
+        Document &document,
+        gint position,
+        gint length
+    )
+/*
+    same bookkeeping as on_sci_notify() for SC_MOD_DELETETEXT
+----------------------------------------------------------------------------- */
+{
+    document.recomputeRanges.Shift(position + length, -length);
+    bracket_edit_delete(
+        document.bracketMap, document.recomputeRanges,
+        position, length
+    );
+    document.length -= length;
+}
+
+
+
+// -----------------------------------------------------------------------------
+    static void run_operation(
+        Document &document,
+        Operation operation
+    )
+/*
+    one edit near the cursor, which now and then jumps somewhere else
+----------------------------------------------------------------------------- */
+{
+    std::uniform_int_distribution<gint> coin(0, 99);
+
+    if (coin(document.random) == 0) {
+        std::uniform_int_distribution<gint> anywhere(1, document.length - 1);
+        document.cursor = anywhere(document.random);
+    }
+
+    if (operation == MIXED) {
+        // mostly typing, some deleting, rarely pasting or opening a block
+        gint roll = coin(document.random);
+        operation =
+            roll < 70 ? TYPE_CHAR :
+            roll < 90 ? DELETE_CHAR :
+            roll < 95 ? PASTE :
+            TYPE_BRACKET;
+    }
+
+    gint cursor = document.cursor;
+
+    switch (operation) {
+        case TYPE_CHAR: {
+            insert_text(document, cursor, 1);
+            document.cursor++;
+            break;
+        }
+        case DELETE_CHAR: {
+            if (cursor > 0) {
+                delete_text(document, cursor - 1, 1);
+                document.cursor--;
+            }
+            break;
+        }
+        case PASTE: {
+            insert_text(document, cursor, sPasteLength);
+            for (gint i = 0; i < sPasteLength; i += sPasteBracketDistance) {
+                document.bracketMap.Update(
+                    cursor + i, BracketType::PAREN, sPasteBracketDistance / 2
+                );
+            }
+            document.cursor += sPasteLength;
+            break;
+        }
+        case TYPE_BRACKET: {
+            insert_text(document, cursor, 1);
+            document.bracketMap.Update(
+                cursor, BracketType::BRACE, sTypedBracketLength
+            );
+            document.cursor++;
+            break;
+        }
+        default:
+            break;
+    }
+
+    recompute(document);
+}
+
+
+
+// -----------------------------------------------------------------------------
+    static std::vector<BracketMatcher::StyledBracket> make_styled_brackets(
+        std::mt19937 &random,
+        gint length
+    )
+/*
+    brackets of every type with a sprinkle of other text, in runs of styles
+    of which only some are code
+----------------------------------------------------------------------------- */
+{
+    static const gchar sText[] = "(){}[]<>x ";
+
+    std::uniform_int_distribution<gint> character(0, sizeof(sText) - 2);
+    std::uniform_int_distribution<gint> runLength(1, 40);
+    std::uniform_int_distribution<gint> style(0, 5);
+
+    std::vector<BracketMatcher::StyledBracket> brackets;
+
+    gint position = 0;
+    while (position < length) {
+        guint8 runStyle = style(random);
+        gint runEnd = std::min(length, position + runLength(random));
+
+        for (; position < runEnd; position++) {
+            guint8 bracketClass = bracket_class(sText[character(random)]);
+            if (bracketClass & BC_CLASS_BRACKET) {
+                brackets.push_back({ position, bracketClass, runStyle });
+            }
+        }
+    }
+
+    return brackets;
+}
+
+
+
+// -----------------------------------------------------------------------------
+    static gboolean same_unmatched(
+        const std::vector<BracketMatcher::Unmatched> &a,
+        const std::vector<BracketMatcher::Unmatched> &b
+    )
+/*
+
+----------------------------------------------------------------------------- */
+{
+    if (a.size() != b.size()) {
+        return FALSE;
+    }
+
+    for (gsize i = 0; i < a.size(); i++) {
+        if (a[i].position != b[i].position or a[i].style != b[i].style) {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+
+
+// -----------------------------------------------------------------------------
+    static gboolean same_matches(
+        const BracketMatcher &a,
+        const BracketMatcher &b
+    )
+/*
+
+----------------------------------------------------------------------------- */
+{
+    for (guint type = 0; type < BracketType::COUNT; type++) {
+        const auto &matchesA = a.mMatches[type];
+        const auto &matchesB = b.mMatches[type];
+        if (matchesA.size() != matchesB.size()) {
+            return FALSE;
+        }
+
+        for (gsize i = 0; i < matchesA.size(); i++) {
+            if (
+                matchesA[i].position != matchesB[i].position or
+                matchesA[i].length != matchesB[i].length
+            ) {
+                return FALSE;
+            }
+        }
+
+        if (
+            not same_unmatched(a.mUnmatchedCloses[type], b.mUnmatchedCloses[type]) or
+            not same_unmatched(a.mUnmatchedOpens[type], b.mUnmatchedOpens[type])
+        ) {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+
+
+// -----------------------------------------------------------------------------
+    static gboolean check_chunked_matching(void)
+/*
+    the parallel analysis must find exactly what one pass finds. Chunks are
+    cut at random positions, so most cuts fall inside runs of one style and
+    some chunks are empty.
+----------------------------------------------------------------------------- */
+{
+    std::mt19937 random(7);
+    std::uniform_int_distribution<gint> numChunks(1, 16);
+    std::uniform_int_distribution<gint> cut(0, sMatcherCheckLength);
+
+    CodeStyleSet codeStyles;
+    codeStyles.set(0);
+    codeStyles.set(1);
+    codeStyles.set(2);
+
+    gboolean enabled[BracketType::COUNT];
+    for (guint i = 0; i < BracketType::COUNT; i++) {
+        enabled[i] = TRUE;
+    }
+
+    BracketMatcher whole;
+    BracketMatcher combined;
+
+    for (gint check = 0; check < sNumMatcherChecks; check++) {
+
+        std::vector<BracketMatcher::StyledBracket> brackets =
+            make_styled_brackets(random, sMatcherCheckLength);
+
+        // the plugin leaves angle brackets off by default
+        enabled[BracketType::ANGLE] = check % 2 == 0;
+
+        whole.Run(brackets, codeStyles, enabled);
+
+        std::vector<gint> cuts;
+        gint count = numChunks(random);
+        for (gint i = 1; i < count; i++) {
+            cuts.push_back(cut(random));
+        }
+        cuts.push_back(sMatcherCheckLength);
+        std::sort(cuts.begin(), cuts.end());
+
+        std::vector<BracketMatcher> chunks(count);
+        auto next = brackets.begin();
+        for (gint i = 0; i < count; i++) {
+            auto end = next;
+            while (end != brackets.end() and end->position < cuts[i]) {
+                end++;
+            }
+
+            std::vector<BracketMatcher::StyledBracket> chunk(next, end);
+            chunks[i].Run(chunk, codeStyles, enabled);
+            next = end;
+        }
+
+        combined.Combine(chunks);
+
+        if (not same_matches(whole, combined)) {
+            printf("chunked matching differs from one pass, check %d\n", check);
+            return FALSE;
+        }
+    }
+
+    printf("chunked matching: %d documents match one pass\n", sNumMatcherChecks);
+    return TRUE;
+}
+
+
+
+// -----------------------------------------------------------------------------
+    static void report(
+        gsize numBrackets,
+        const gchar *name,
+        gsize numOperations,
+        gdouble elapsedNs,
+        gsize numAllocations
+    )
+/*
+
+----------------------------------------------------------------------------- */
+{
+    printf(
+        "%10zu  %-14s %8zu %14.1f %10.2f\n",
+        numBrackets, name, numOperations,
+        elapsedNs / numOperations,
+        gdouble(numAllocations) / numOperations
+    );
+}
+
+
+
+// -----------------------------------------------------------------------------
+    int main(
+        int argc,
+        char **argv
+    )
+/*
+
+----------------------------------------------------------------------------- */
+{
+    typedef std::chrono::steady_clock Clock;
+
+    gint maxExponent = argc > 1 ? atoi(argv[1]) : 7;
+
+    if (not check_chunked_matching()) {
+        return 1;
+    }
+
+    printf(
+        "%10s  %-14s %8s %14s %10s\n",
+        "brackets", "operation", "ops", "ns/op", "allocs/op"
+    );
+
+    gsize numBrackets = 100;
+    for (gint exponent = 2; exponent <= maxExponent; exponent++, numBrackets *= 10) {
+
+        // building counts per bracket
+        {
+            Document document;
+
+            gsize allocations = gNumAllocations;
+            auto start = Clock::now();
+            make_document(document, numBrackets);
+            std::chrono::duration<gdouble, std::nano> elapsed = Clock::now() - start;
+
+            report(
+                numBrackets, "build", numBrackets,
+                elapsed.count(), gNumAllocations - allocations
+            );
+        }
+
+        /*
+         * Edits move the gap of the map over what changed since the last
+         * one, keep large sizes bearable. Small documents are rebuilt every few edits so they stay the size
+         * they are supposed to be.
+         */
+
+        gsize numOperations = CLAMP(G_GUINT64_CONSTANT(100000000) / numBrackets, 100, 100000);
+        gsize roundLength = CLAMP(numBrackets / 10, 1, numOperations);
+
+        for (gint operation = 0; operation < NUM_OPERATIONS; operation++) {
+
+            std::chrono::duration<gdouble, std::nano> elapsed(0);
+            gsize allocations = 0;
+
+            for (gsize done = 0; done < numOperations; done += roundLength) {
+                Document document;
+                make_document(document, numBrackets);
+
+                gsize allocationsBefore = gNumAllocations;
+                auto start = Clock::now();
+
+                for (gsize i = 0; i < roundLength; i++) {
+                    run_operation(document, static_cast<Operation>(operation));
+                }
+
+                elapsed += Clock::now() - start;
+                allocations += gNumAllocations - allocationsBefore;
+            }
+
+            gsize numRounds = (numOperations + roundLength - 1) / roundLength;
+            report(
+                numBrackets, sOperationNames[operation], numRounds * roundLength,
+                elapsed.count(), allocations
+            );
+        }
+
+        fflush(stdout);
+    }
+
+    return 0;
+}
@@ -0,0 +1,429 @@
+/*
+ *      BracketReplay.cc
+ *
+ *      Copyright 2023 Asif Amin <asifamin@utexas.edu>
+ *
+ *      This program is free software; you can redistribute it and/or modify
+ *      it under the terms of the GNU General Public License as published by
+ *      the Free Software Foundation; either version 2 of the License, or
+ *      (at your option) any later version.
+ *
+ *      This program is distributed in the hope that it will be useful,
+ *      but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *      GNU General Public License for more details.
+ *      You should have received a copy of the GNU General Public License
+ *      along with this program; if not, write to the Free Software
+ *      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ *      MA 02110-1301, USA.
+ */
+
+/*
+ * Replays a trace recorded by the plugin against an in-memory document and
+ * reports how long the engine took for every kind of event:
+ *
+ *      make bracketcolors_replay && ./src/bracketcolors_replay file.bctrace
+ *
+ * Every event is handled to completion, the way the plugin would if its
+ * time budget never ran out. Brackets are matched like SCI_BRACEMATCH does.
+ */
+
+/* --------------------------------- INCLUDES ------------------------------- */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include <glib.h>
+
+#include "BracketClassifier.h"
+#include "BracketEdits.h"
+#include "BracketMap.h"
+#include "BracketMatcher.h"
+#include "DirtyRanges.h"
+#include "EditLog.h"
+#include "TraceRecorder.h"
+
+/* ----------------------------------- TYPES -------------------------------- */
+
+    struct ReplayDocument {
+
+        /*
+         * What Scintilla and the plugin hold for the traced document
+         */
+
+        std::string text;
+        std::vector<guint8> styles;
+
+        CodeStyleSet codeStyles;
+        gboolean enabled[BracketType::COUNT];
+
+        BracketMap bracketMap;
+        DirtyRanges recomputeRanges;
+        EditLog editLog;
+        std::vector<BracketMap::Index> updatedBrackets;
+    };
+
+    // latencies of one kind of event, in nanoseconds
+    struct Latencies {
+        const gchar *name;
+        std::vector<gdouble> samples;
+    };
+
+/* ------------------------------ IMPLEMENTATION ---------------------------- */
+
+
+// -----------------------------------------------------------------------------
+    static void analyze(
+        ReplayDocument &document
+    )
+/*
+    pair every bracket of the document, what the plugin does on activation
+----------------------------------------------------------------------------- */
+{
+    std::vector<BracketHit> hits;
+    bracket_scan_block(document.text.data(), document.text.size(), 0, hits);
+
+    std::vector<BracketMatcher::StyledBracket> brackets;
+    for (const BracketHit &hit : hits) {
+        if (document.enabled[bracket_class_type(hit.bracketClass)]) {
+            brackets.push_back(
+                { hit.position, hit.bracketClass, document.styles[hit.position] }
+            );
+        }
+    }
+
+    BracketMatcher matcher;
+    matcher.Run(brackets, document.codeStyles, document.enabled);
+
+    std::vector<BracketMap::Entry> entries;
+    for (guint type = 0; type < BracketType::COUNT; type++) {
+        for (const BracketMatcher::Match &match : matcher.mMatches[type]) {
+            entries.push_back(
+                { match.position, match.length, static_cast<BracketMap::Type>(type) }
+            );
+        }
+    }
+
+    std::sort(
+        entries.begin(), entries.end(),
+        [](const BracketMap::Entry &a, const BracketMap::Entry &b) {
+            return a.position < b.position;
+        }
+    );
+
+    document.bracketMap.Assign(entries);
+    document.updatedBrackets.clear();
+    document.bracketMap.ComputeOrder(document.updatedBrackets);
+}
+
+
+
+// -----------------------------------------------------------------------------
+    static gint brace_match(
+        const ReplayDocument &document,
+        gint position
+    )
+/*
+    same rules as SCI_BRACEMATCH: count brackets of the same pair and style
+    until the depth returns to zero, -1 if it never does
+----------------------------------------------------------------------------- */
+{
+    const std::string &text = document.text;
+    const std::vector<guint8> &styles = document.styles;
+
+    guint8 bracketClass = bracket_class(text[position]);
+    guint8 style = styles[position];
+    gint direction = (bracketClass & BC_CLASS_OPEN) ? 1 : -1;
+    gint depth = 0;
+
+    for (gint i = position; i >= 0 and i < gint(text.size()); i += direction) {
+        guint8 currentClass = bracket_class(text[i]);
+        if (
+            not (currentClass & BC_CLASS_BRACKET) or
+            bracket_class_type(currentClass) != bracket_class_type(bracketClass) or
+            styles[i] != style
+        ) {
+            continue;
+        }
+
+        depth += (currentClass & BC_CLASS_OPEN) == (bracketClass & BC_CLASS_OPEN) ? 1 : -1;
+        if (depth == 0) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+
+
+// -----------------------------------------------------------------------------
+    static void recompute_bracket(
+        ReplayDocument &document,
+        gint position,
+        guint8 bracketClass
+    )
+/*
+    what recompute_bracket() and compute_bracket_at() do in the plugin
+----------------------------------------------------------------------------- */
+{
+    BracketMap &bracketMap = document.bracketMap;
+    BracketType type = bracket_class_type(bracketClass);
+
+    if (not document.enabled[type]) {
+        return;
+    }
+
+    if (not document.codeStyles.test(document.styles[position])) {
+        bracketMap.Erase(position);
+        return;
+    }
+
+    gint match = brace_match(document, position);
+    if (match >= 0) {
+        gint length = match - position;
+        if (length > 0) {
+            bracketMap.Update(position, type, length);
+        }
+        else {
+            bracketMap.Update(match, type, -length);
+        }
+    }
+    else if (bracketClass & BC_CLASS_OPEN) {
+        bracketMap.Update(position, type, BracketMap::UNDEFINED);
+    }
+}
+
+
+
+// -----------------------------------------------------------------------------
+    static void recompute(
+        ReplayDocument &document
+    )
+/*
+    apply logged edits, work through every queued range, then update
+    nesting orders
+----------------------------------------------------------------------------- */
+{
+    bracket_edit_apply(document.bracketMap, document.recomputeRanges, document.editLog);
+
+    std::vector<BracketHit> hits;
+
+    DirtyRanges::Range range;
+    while (document.recomputeRanges.First(0, G_MAXINT, range)) {
+        document.recomputeRanges.Remove(range.first, range.second);
+
+        gint end = std::min<gint>(range.second, document.text.size());
+        if (range.first >= end) {
+            continue;
+        }
+
+        hits.clear();
+        bracket_scan_block(
+            document.text.data() + range.first, end - range.first,
+            range.first, hits
+        );
+
+        for (const BracketHit &hit : hits) {
+            recompute_bracket(document, hit.position, hit.bracketClass);
+        }
+    }
+
+    document.updatedBrackets.clear();
+    document.bracketMap.ComputeOrder(document.updatedBrackets);
+}
+
+
+
+// -----------------------------------------------------------------------------
+    static void replay_event(
+        ReplayDocument &document,
+        const TraceEvent &event
+    )
+/*
+    apply event to the document text, then do what on_sci_notify() and the
+    recompute timer would
+----------------------------------------------------------------------------- */
+{
+    gint position = event.position;
+    gint length = event.length;
+
+    switch (event.type) {
+
+        case TraceEvent::INSERT: {
+            document.text.insert(position, event.text);
+            document.styles.insert(document.styles.begin() + position, length, 0);
+
+            document.recomputeRanges.Shift(position, length);
+            document.recomputeRanges.Add(position, position + length);
+            document.editLog.Insert(position, length);
+            break;
+        }
+
+        case TraceEvent::DELETE: {
+            document.text.erase(position, length);
+            document.styles.erase(
+                document.styles.begin() + position,
+                document.styles.begin() + position + length
+            );
+
+            document.recomputeRanges.Shift(position + length, -length);
+            document.editLog.Delete(position, length);
+            break;
+        }
+
+        case TraceEvent::STYLE: {
+            std::copy(
+                event.styles.begin(), event.styles.end(),
+                document.styles.begin() + position
+            );
+            document.recomputeRanges.Add(position, position + length);
+            break;
+        }
+    }
+
+    recompute(document);
+}
+
+
+
+// -----------------------------------------------------------------------------
+    static gdouble percentile(
+        const std::vector<gdouble> &sorted,
+        guint percent
+    )
+/*
+
+----------------------------------------------------------------------------- */
+{
+    gsize index = std::min(sorted.size() * percent / 100, sorted.size() - 1);
+    return sorted[index];
+}
+
+
+
+// -----------------------------------------------------------------------------
+    static void report(
+        Latencies &latencies
+    )
+/*
+
+----------------------------------------------------------------------------- */
+{
+    std::vector<gdouble> &samples = latencies.samples;
+    if (samples.empty()) {
+        return;
+    }
+
+    std::sort(samples.begin(), samples.end());
+
+    gdouble total = 0;
+    for (gdouble sample : samples) {
+        total += sample;
+    }
+
+    printf(
+        "%-10s %9zu %10.1f %10.1f %10.1f %10.1f %10.1f\n",
+        latencies.name, samples.size(),
+        percentile(samples, 50) / 1000,
+        percentile(samples, 90) / 1000,
+        percentile(samples, 99) / 1000,
+        samples.back() / 1000,
+        total / 1000000
+    );
+}
+
+
+
+// -----------------------------------------------------------------------------
+    int main(
+        int argc,
+        char **argv
+    )
+/*
+
+----------------------------------------------------------------------------- */
+{
+    typedef std::chrono::steady_clock Clock;
+    typedef std::chrono::duration<gdouble, std::nano> Nanoseconds;
+
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s TRACE\n", argv[0]);
+        return 2;
+    }
+
+    TraceReader reader;
+    if (not reader.Open(argv[1])) {
+        return 1;
+    }
+
+    TraceEvent event;
+    if (not reader.Next(event) or event.type != TraceEvent::DOCUMENT) {
+        fprintf(stderr, "%s: trace does not start with a document\n", argv[1]);
+        return 1;
+    }
+
+    ReplayDocument document;
+    document.text.swap(event.text);
+    document.styles.swap(event.styles);
+    document.codeStyles = event.codeStyles;
+    for (guint i = 0; i < BracketType::COUNT; i++) {
+        document.enabled[i] = event.enabled[i];
+    }
+
+    Latencies analysis = { "analyze", {} };
+    Latencies inserts = { "insert", {} };
+    Latencies deletes = { "delete", {} };
+    Latencies restyles = { "style", {} };
+    Latencies all = { "all", {} };
+
+    auto start = Clock::now();
+    analyze(document);
+    analysis.samples.push_back(Nanoseconds(Clock::now() - start).count());
+
+    gint64 duration = 0;
+    while (reader.Next(event)) {
+
+        if (
+            event.position < 0 or event.length < 0 or
+            gsize(event.position) + (event.type == TraceEvent::INSERT ? 0 : event.length) >
+                document.text.size()
+        ) {
+            fprintf(stderr, "%s: event out of range, stopping\n", argv[1]);
+            break;
+        }
+
+        start = Clock::now();
+        replay_event(document, event);
+        gdouble elapsed = Nanoseconds(Clock::now() - start).count();
+
+        Latencies &latencies =
+            event.type == TraceEvent::INSERT ? inserts :
+            event.type == TraceEvent::DELETE ? deletes :
+            restyles;
+
+        latencies.samples.push_back(elapsed);
+        all.samples.push_back(elapsed);
+
+        duration = event.time;
+    }
+
+    printf(
+        "%zu bytes, %zu brackets, %zu events over %.1f s\n\n",
+        document.text.size(), document.bracketMap.Size(),
+        all.samples.size(), duration / 1e6
+    );
+    printf(
+        "%-10s %9s %10s %10s %10s %10s %10s\n",
+        "event", "count", "p50 us", "p90 us", "p99 us", "max us", "total ms"
+    );
+
+    for (Latencies *latencies : { &analysis, &inserts, &deletes, &restyles, &all }) {
+        report(*latencies);
+    }
+
+    return 0;
+}
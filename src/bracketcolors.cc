@@ -26,6 +26,8 @@
 #endif
 
 #include <string.h>
+#include <algorithm>
+#include <vector>
 #ifdef HAVE_LOCALE_H
 # include <locale.h>
 #endif
@@ -33,7 +35,20 @@
 #include <geanyplugin.h>
 #include "sciwrappers.h"
 
+#include "BracketAnalysis.h"
+#include "BracketCache.h"
 #include "BracketMap.h"
+#include "BracketClassifier.h"
+#include "BracketEdits.h"
+#include "BracketHistory.h"
+#include "BracketMatcher.h"
+#include "BracketScanner.h"
+#include "DirtyRanges.h"
+#include "EditLog.h"
+#include "IndicatorPainter.h"
+#include "Metrics.h"
+#include "TraceRecorder.h"
+#include "WorkBudget.h"
 #include "Utils.h"
 #include "Configuration.h"
 
@@ -41,7 +56,7 @@
 #define BC_STOP_ACTION TRUE
 #define BC_CONTINUE_ACTION FALSE
 
-#define SSM(s, m, w, l) scintilla_send_message(s, m, w, l)
+#define SSM(s, m, w, l) (BC_METRICS_COUNT_MESSAGE(m), scintilla_send_message(s, m, w, l))
 
 
 /* --------------------------------- CONSTANTS ------------------------------ */
@@ -51,14 +66,60 @@
     // start index of indicators our plugin will use
     static const guint sIndicatorIndex = INDICATOR_IME - BC_NUM_COLORS;
 
+    // time each timer tick may spend on queued work, in microseconds
+    static const gint64 sBaseTickBudget = 4 * 1000;
+    static const gint64 sMaxTickBudget = 32 * 1000;
+
+    // queued brackets this close together are redrawn as one range
+    static const gint sRedrawMergeDistance = 64;
+
+    // modifications closer together than this are handled as one burst,
+    // in microseconds
+    static const gint64 sBurstInterval = 2 * 1000;
+
+    // queued work below this many characters is never worth a rebuild
+    static const gsize sMinRebuildWork = 64 * 1024;
+
+    // dirty ranges are worked through in pieces of this many characters
+    static const gint sWorkPieceSize = 4096;
+
+    // bracket maps kept on disk, the oldest are removed past this
+    static const guint sMaxCacheFiles = 1024;
+
+    // larger documents are not hashed for the disk cache when Geany quits
+    static const gint sMaxShutdownCacheLength = 4 * 1024 * 1024;
+
 /* ----------------------------------- TYPES -------------------------------- */
 
-    enum BracketType {
-        PAREN = 0,
-        BRACE,
-        BRACKET,
-        ANGLE,
-        COUNT
+    struct WakeupCounter {
+
+        /*
+         * How often our work sources dispatch, should be zero when idle
+         */
+
+        gint64 windowStart;
+        guint numWakeups, lastRate;
+
+        WakeupCounter() : windowStart(0), numWakeups(0), lastRate(0) {}
+
+        void Tick();
+        guint PerSecond() const;
+    };
+
+    struct StartupReport {
+
+        /*
+         * Time our handlers took while geany was starting up
+         */
+
+        gint64 elapsed;
+        guint numDocuments, numSetUp;
+        gboolean complete;
+
+        StartupReport() : elapsed(0), numDocuments(0), numSetUp(0), complete(FALSE) {}
+
+        void Add(gint64 startTime, gboolean setUp);
+        void Finish();
     };
 
     struct BracketColorsData {
@@ -72,22 +133,104 @@
 
         gboolean init;
 
-        guint computeTimeoutID, computeInterval;
-        guint drawTimeoutID;
+        // dormant until work is queued, see ScheduleCompute()/ScheduleDraw()
+        GSource *computeSource;
+        guint computeInterval;
+        GSource *drawSource;
+        guint drawInterval;
+
+        // per tick time budgets in microseconds, grown while we fall behind
+        gint64 computeBudget, drawBudget;
 
         gboolean updateUI;
-        std::set<BracketMap::Index> recomputeIndicies, redrawIndicies;
+
+        // document range currently on screen, its brackets are done first
+        gint visibleStart, visibleEnd;
+        DirtyRanges recomputeRanges, redrawRanges;
+
+        // reused for every ComputeOrder() call
+        std::vector<BracketMap::Index> updatedBrackets;
 
         gboolean bracketColorsEnable[BracketType::COUNT];
-        BracketMap bracketMaps[BracketType::COUNT];
+        BracketMap bracketMap;
+
+        // edits the bracket map has not caught up with, see ApplyEdits()
+        EditLog editLog;
+
+        // edits of the current burst the queues have not seen, see EndBurst()
+        EditLog burstLog;
+        gint64 lastModification;
+
+        // edits queued work since the last tick, see rebuild_is_cheaper()
+        gboolean queueGrew;
+
+        // maps saved around big undo actions, see track_undo_action()
+        BracketHistory history;
+
+        // no edits since undo, redo or the disk cache restored a saved map
+        gboolean restored;
+
+        // code styles of the current lexer, rebuilt when the filetype changes
+        gboolean codeStylesValid;
+        CodeStyleSet codeStyles;
+
+        IndicatorPainter painter;
+
+        // bumped by every edit, background results for older ones are stale
+        guint64 generation;
+        gboolean analysisPending;
+        GCancellable *analysisCancellable;
+
+        // snapshot held by a pending analysis
+        gsize analysisBytes;
+
+        // least recently activated documents are dropped first
+        gint64 lastActivated;
+
+        // bracket map of an inactive document, see Hibernate()
+        gboolean hibernated;
+        guint64 hibernatedGeneration;
+        std::vector<guint8> hibernatedMap;
+
+        // analysis freed by DropAnalysis(), indicators match this generation
+        gboolean dropped;
+        guint64 droppedGeneration;
+
+        // the disk cache already has the current map, see store_cached_brackets()
+        gboolean cacheStored;
+
+        // modifications written to disk when traces are recorded
+        TraceRecorder traceRecorder;
+
 
         BracketColorsData() :
             doc(NULL),
             init(FALSE),
-            computeTimeoutID(0),
-            computeInterval(500),
-            drawTimeoutID(0),
-            updateUI(FALSE)
+            computeSource(NULL),
+            computeInterval(20),
+            drawSource(NULL),
+            drawInterval(100),
+            computeBudget(sBaseTickBudget),
+            drawBudget(sBaseTickBudget),
+            updateUI(FALSE),
+            visibleStart(0),
+            visibleEnd(0),
+            redrawRanges(sRedrawMergeDistance),
+            lastModification(0),
+            queueGrew(FALSE),
+            restored(FALSE),
+            codeStylesValid(FALSE),
+            painter(sIndicatorIndex, BC_NUM_COLORS),
+            generation(0),
+            analysisPending(FALSE),
+            analysisCancellable(g_cancellable_new()),
+            analysisBytes(0),
+            lastActivated(0),
+            hibernated(FALSE),
+            hibernatedGeneration(0),
+            dropped(FALSE),
+            droppedGeneration(0),
+            cacheStored(FALSE)
         {
             for (guint i = 0; i < BracketType::COUNT; i++) {
                 bracketColorsEnable[i] = TRUE;
@@ -101,16 +244,36 @@
             bracketColorsEnable[BracketType::ANGLE] = FALSE;
         }
 
-        ~BracketColorsData() {}
+        ~BracketColorsData() {
+            StopTimers();
+            g_cancellable_cancel(analysisCancellable);
+            g_object_unref(analysisCancellable);
+        }
 
-        void RemoveFromQueues(BracketMap::Index index);
+        void ShiftQueues(BracketMap::Index position, gint delta);
+        void ApplyEdits();
+        gboolean InBurst(gint modificationType);
+        void EndBurst();
+        void Rebuild();
         void StartTimers();
         void StopTimers();
+        void ScheduleCompute();
+        void ScheduleDraw();
+
+        const CodeStyleSet& GetCodeStyles();
+
+        gsize MemoryUsage() const;
+        void DropAnalysis();
+        void Hibernate();
+        void Wake();
     };
 
 /* ---------------------------------- GLOBALS ------------------------------- */
 
     static BracketColorsPluginConfiguration gPluginConfiguration(TRUE, sLightBackgroundColors);
+    static WakeupCounter gWakeupCounter;
+    static StartupReport gStartupReport;
+    static BracketCache gBracketCache("");
 
 /* ---------------------------------- EXTERNS ------------------------------- */
 
@@ -121,590 +284,1880 @@
 
     static gboolean recompute_brackets_timeout(gpointer user_data);
     static gboolean render_brackets_timeout(gpointer user_data);
+    static gboolean work_source_dispatch(GSource *source, GSourceFunc callback, gpointer user_data);
+    static void update_visible_range(BracketColorsData *data);
+    static void recompute_visible_range(BracketColorsData *data);
+    static void enforce_memory_budget(void);
+
+    static GSourceFuncs sWorkSourceFuncs = {
+        NULL, NULL, work_source_dispatch, NULL, NULL, NULL
+    };
 
 /* ------------------------------ IMPLEMENTATION ---------------------------- */
 
 
 // -----------------------------------------------------------------------------
-    void BracketColorsData::StartTimers()
-
+    void WakeupCounter::Tick()
 /*
-
+    count a wakeup, the rate is taken over one second windows
 ----------------------------------------------------------------------------- */
 {
-    if (computeTimeoutID == 0) {
-        computeTimeoutID = g_timeout_add_full(
-            G_PRIORITY_LOW,
-            20,
-            recompute_brackets_timeout,
-            this,
-            NULL
-        );
+    gint64 now = g_get_monotonic_time();
+    gint64 elapsed = now - windowStart;
+
+    if (elapsed >= G_USEC_PER_SEC) {
+        // a window with no wakeups in between means we were idle
+        lastRate = elapsed < 2 * G_USEC_PER_SEC ? numWakeups : 0;
+        windowStart = now;
+        numWakeups = 0;
     }
 
-    if (drawTimeoutID == 0) {
-        drawTimeoutID = g_timeout_add_full(
-            G_PRIORITY_LOW,
-            100,
-            render_brackets_timeout,
-            this,
-            NULL
-        );
-    }
+    numWakeups++;
 }
 
 
 
 // -----------------------------------------------------------------------------
-    void BracketColorsData::StopTimers()
-
+    guint WakeupCounter::PerSecond() const
 /*
-
+    wakeups during the last full second
 ----------------------------------------------------------------------------- */
 {
-    if (computeTimeoutID > 0) {
-        g_source_remove(computeTimeoutID);
-        computeTimeoutID = 0;
-    }
+    gint64 elapsed = g_get_monotonic_time() - windowStart;
 
-    if (drawTimeoutID > 0) {
-        g_source_remove(drawTimeoutID);
-        drawTimeoutID = 0;
+    if (elapsed >= 2 * G_USEC_PER_SEC) {
+        return 0;
     }
+    if (elapsed >= G_USEC_PER_SEC) {
+        return numWakeups;
+    }
+
+    return lastRate;
 }
 
 
 
 // -----------------------------------------------------------------------------
-    void BracketColorsData::RemoveFromQueues(BracketMap::Index index)
-
+    void StartupReport::Add(gint64 startTime, gboolean setUp)
 /*
-
+    count a document opened since startTime, until startup is over
 ----------------------------------------------------------------------------- */
 {
-    {
-        auto it = recomputeIndicies.find(index);
-        if (it != recomputeIndicies.end()) {
-            recomputeIndicies.erase(it);
-        }
+    if (complete) {
+        return;
     }
-    {
-        auto it = redrawIndicies.find(index);
-        if (it != redrawIndicies.end()) {
-            redrawIndicies.erase(it);
-        }
+
+    elapsed += g_get_monotonic_time() - startTime;
+    numDocuments++;
+    if (setUp) {
+        numSetUp++;
     }
 }
 
 
 
 // -----------------------------------------------------------------------------
-    static void assign_indicator_colors(
-        BracketColorsData *data
-    )
+    void StartupReport::Finish()
 /*
-
+    log what we added to startup, shows up in Help > Debug Messages
 ----------------------------------------------------------------------------- */
 {
-    ScintillaObject *sci = data->doc->editor->sci;
-
-    for (guint i = 0; i < gPluginConfiguration.mColors.size(); i++) {
-        guint index = sIndicatorIndex + i;
-        std::string spec = gPluginConfiguration.mColors.at(i);
-        gint color = utils_parse_color_to_bgr(spec.c_str());
-        SSM(sci, SCI_INDICSETSTYLE, index, INDIC_TEXTFORE);
-        SSM(sci, SCI_INDICSETFORE, index, color);
+    if (complete) {
+        return;
     }
+
+    complete = TRUE;
+
+    g_message(
+        "%s: %.1f ms during startup, %u of %u documents set up",
+        sPluginName, elapsed / 1000.0, numSetUp, numDocuments
+    );
 }
 
 
 
 // -----------------------------------------------------------------------------
-    static gboolean has_document(void)
+    static gboolean work_source_dispatch(
+        GSource *source,
+        GSourceFunc callback,
+        gpointer user_data
+    )
 /*
-    sanity check
+    a work source only fires once per arming, the callback re-arms it if
+    there is still work left
 ----------------------------------------------------------------------------- */
 {
-    GtkNotebook *notebook = GTK_NOTEBOOK(geany_data->main_widgets->notebook);
-    gint currPage = gtk_notebook_get_current_page(notebook);
-    return currPage >= 0 ? TRUE : FALSE;
+    g_source_set_ready_time(source, -1);
+    gWakeupCounter.Tick();
+
+    return callback(user_data);
 }
 
 
 
 // -----------------------------------------------------------------------------
-    static gboolean is_curr_document(
-        BracketColorsData *data
+    static GSource* work_source_new(
+        GSourceFunc callback,
+        gpointer user_data
     )
 /*
-    check if this document is currently opened
+    make a dormant source for callback on the default context
 ----------------------------------------------------------------------------- */
 {
-    GtkNotebook *notebook = GTK_NOTEBOOK(geany_data->main_widgets->notebook);
-    gint currPage = gtk_notebook_get_current_page(notebook);
-    GeanyDocument *currDoc = document_get_from_page(currPage);
+    GSource *source = g_source_new(&sWorkSourceFuncs, sizeof(GSource));
 
-    if (currDoc != NULL and currDoc == data->doc) {
-        return TRUE;
-    }
+    g_source_set_priority(source, G_PRIORITY_LOW);
+    g_source_set_callback(source, callback, user_data, NULL);
+    g_source_set_ready_time(source, -1);
+    g_source_attach(source, NULL);
 
-    return FALSE;
+    return source;
 }
 
 
 
 // -----------------------------------------------------------------------------
-    static void bracket_colors_data_free(gpointer data)
+    static void work_source_free(
+        GSource *&source
+    )
 /*
 
 ----------------------------------------------------------------------------- */
 {
-    BracketColorsData *bcd = reinterpret_cast<BracketColorsData *>(data);
-    delete bcd;
+    if (source != NULL) {
+        g_source_destroy(source);
+        g_source_unref(source);
+        source = NULL;
+    }
 }
 
 
 
 // -----------------------------------------------------------------------------
-    static BracketColorsData* bracket_colors_data_new(GeanyDocument *doc)
+    static void work_source_arm(
+        GSource *source,
+        guint interval
+    )
 /*
-
+    fire in interval ms unless already armed, pending wakeups are not
+    pushed back so steady typing cannot starve the work
 ----------------------------------------------------------------------------- */
 {
-    BracketColorsData *newBCD = new BracketColorsData();
-
-    plugin_set_document_data_full(
-        geany_plugin,
-        doc,
-        sPluginName,
-        newBCD,
-        bracket_colors_data_free
-    );
-
-    return newBCD;
+    if (source != NULL and g_source_get_ready_time(source) < 0) {
+        g_source_set_ready_time(
+            source,
+            g_get_monotonic_time() + interval * G_TIME_SPAN_MILLISECOND
+        );
+    }
 }
 
 
 
 // -----------------------------------------------------------------------------
-    static gboolean is_bracket_type(
-        gchar ch,
-        BracketType type
-    )
+    void BracketColorsData::StartTimers()
+
 /*
-    check if char is bracket type
+    create our work sources, they only wake up when there is something to do
 ----------------------------------------------------------------------------- */
 {
-    static const std::set<gchar> sAllBrackets {
-        '(', ')',
-        '[', ']',
-        '{', '}',
-        '<', '>',
-    };
+    if (computeSource == NULL) {
+        computeSource = work_source_new(recompute_brackets_timeout, this);
+    }
 
-    switch (type) {
-        case (BracketType::PAREN): {
-            if (ch == '(' or ch == ')') {
-                return TRUE;
-            }
-            return FALSE;
-        }
-        case(BracketType::BRACE): {
-            if (ch == '[' or ch == ']') {
-                return TRUE;
-            }
-            return FALSE;
-        }
-        case(BracketType::BRACKET): {
-            if (ch == '{' or ch == '}') {
-                return TRUE;
-            }
-            return FALSE;
-        }
-        case(BracketType::ANGLE): {
-            if (ch == '<' or ch == '>') {
-                return TRUE;
-            }
-            return FALSE;
-        }
-        case(BracketType::COUNT): {
-            return sAllBrackets.find(ch) != sAllBrackets.end() ? TRUE : FALSE;
-        }
-        default:
-            return FALSE;
+    if (drawSource == NULL) {
+        drawSource = work_source_new(render_brackets_timeout, this);
     }
 
+    if (not init or not recomputeRanges.Empty() or not editLog.Empty()) {
+        ScheduleCompute();
+    }
+
+    if (updateUI) {
+        ScheduleDraw();
+    }
 }
 
 
 
 // -----------------------------------------------------------------------------
-    static gboolean is_open_bracket(
-        gchar ch,
-        BracketType type
-    )
+    void BracketColorsData::StopTimers()
+
 /*
-    check if char is open bracket type
+
 ----------------------------------------------------------------------------- */
 {
-    static const std::set<gchar> sAllOpenBrackets {
-        '(',
-        '[',
-        '{',
-        '<',
-    };
-
-    switch (type) {
-        case (BracketType::PAREN): {
-            if (ch == '(') {
-                return TRUE;
-            }
-            return FALSE;
-        }
-        case(BracketType::BRACE): {
-            if (ch == '[') {
-                return TRUE;
-            }
-            return FALSE;
-        }
-        case(BracketType::BRACKET): {
-            if (ch == '{') {
-                return TRUE;
-            }
-            return FALSE;
-        }
-        case(BracketType::ANGLE): {
-            if (ch == '<') {
-                return TRUE;
-            }
-            return FALSE;
-        }
-        case(BracketType::COUNT): {
-            return sAllOpenBrackets.find(ch) != sAllOpenBrackets.end() ? TRUE : FALSE;
-        }
-        default:
-            return FALSE;
-    }
-
+    work_source_free(computeSource);
+    work_source_free(drawSource);
 }
 
 
+
 // -----------------------------------------------------------------------------
-    static gboolean is_ignore_style(
-        ScintillaObject *sci,
-        gint position
-    )
+    void BracketColorsData::ScheduleCompute()
+
 /*
-    check if position is part of non source section
+
 ----------------------------------------------------------------------------- */
 {
-    gint style = SSM(sci, SCI_GETSTYLEAT, position, BC_NO_ARG);
-    gint lexer = sci_get_lexer(sci);
-
-    return not highlighting_is_code_style(lexer, style);
+    work_source_arm(computeSource, computeInterval);
 }
 
 
 
 // -----------------------------------------------------------------------------
-    static gint compute_bracket_at(
-        ScintillaObject *sci,
-        BracketMap &bracketMap,
-        gint position,
-        bool updateInvalidMapping = true
-    )
+    void BracketColorsData::ScheduleDraw()
+
 /*
-    compute bracket at position
-    braceIdentity == -1 : unknown start brace
-    braceIdentity == -2 : invalid computation
+
 ----------------------------------------------------------------------------- */
 {
-    gint matchedBrace = SSM(sci, SCI_BRACEMATCH, position, BC_NO_ARG);
-    gint braceIdentity = position;
-
-    if (is_ignore_style(sci, position) or is_ignore_style(sci, matchedBrace)) {
-        // https://www.scintilla.org/ScintillaDoc.html#SCI_BRACEMATCH
-        // A match only occurs if the style of the matching brace is the same as
-        // the starting brace or the matching brace is beyond the end of styling.
-        return -2;
-    }
+    work_source_arm(drawSource, drawInterval);
+}
 
-    if (matchedBrace != -1) {
 
-        gint length = matchedBrace - position;
 
-        if (length > 0) {
-            // matched from start brace
-            bracketMap.Update(position, length);
-        }
-        else {
-            // matched from end brace
-            length = -length;
-            braceIdentity = position - length;
-            bracketMap.Update(braceIdentity, length);
-        }
-    }
-    else {
-        // invalid mapping
+// -----------------------------------------------------------------------------
+    void BracketColorsData::ShiftQueues(BracketMap::Index position, gint delta)
 
-        if (is_open_bracket(sci_get_char_at(sci, position), BracketType::COUNT)) {
-            if (updateInvalidMapping) {
-                bracketMap.Update(position, BracketMap::UNDEFINED);
-            }
-        }
-        else {
-            // unknown start brace
-            braceIdentity = -1;
-        }
-    }
+/*
 
-    return braceIdentity;
+----------------------------------------------------------------------------- */
+{
+    recomputeRanges.Shift(position, delta);
+    redrawRanges.Shift(position, delta);
 }
 
 
 
-
 // -----------------------------------------------------------------------------
-    static void find_all_brackets(
-        BracketColorsData &data
-    )
+    void BracketColorsData::ApplyEdits()
+
 /*
-    brute force search for brackets
+    move brackets for everything typed since the last tick. Keystrokes only
+    append to editLog, so their cost does not grow with the document.
 ----------------------------------------------------------------------------- */
 {
-    ScintillaObject *sci = data.doc->editor->sci;
+    // positions queued from here on are in the current text
+    EndBurst();
 
-    gint length = sci_get_length(sci);
-    for (gint i = 0; i < length; i++) {
-        gchar ch = sci_get_char_at(sci, i);
-        if (is_bracket_type(ch, BracketType::COUNT)) {
-            for (gint bracketType = 0; bracketType < BracketType::COUNT; bracketType++) {
-                if (data.bracketColorsEnable[bracketType] == TRUE) {
-                    if (is_bracket_type(ch, static_cast<BracketType>(bracketType))) {
-                        data.recomputeIndicies.insert(i);
-                        data.updateUI = TRUE;
-                        break;
-                    }
-                }
-            }
-        }
+    if (editLog.Empty()) {
+        return;
+    }
+
+    // the map moves on, save it for undo if the action in progress is big
+    history.Capture(bracketMap);
+
+    BC_METRICS_SCOPE(TIMER_APPLY_EDITS);
+
+    if (bracket_edit_apply(bracketMap, recomputeRanges, editLog)) {
+        updateUI = TRUE;
     }
+
+    queueGrew = TRUE;
 }
 
 
 
 // -----------------------------------------------------------------------------
-    static void remove_bc_indicators(
-        ScintillaObject *sci
-    )
+    gboolean BracketColorsData::InBurst(gint modificationType)
+
 /*
-    remove indicators associated with this plugin
+    Replace All, typing with several carets and macros send modifications
+    back to back, as do multi step undo and redo. Those are folded into
+    burstLog and the queues catch up once, in EndBurst().
 ----------------------------------------------------------------------------- */
 {
-    gint length = sci_get_length(sci);
-    for (gint i = 0; i < BC_NUM_COLORS; i++) {
-        SSM(sci, SCI_SETINDICATORCURRENT, sIndicatorIndex + i, BC_NO_ARG);
-        SSM(sci, SCI_INDICATORCLEARRANGE, 0, length);
-    }
+    gint64 now = g_get_monotonic_time();
+    gboolean burst =
+        (modificationType & SC_MULTISTEPUNDOREDO) or
+        now - lastModification < sBurstInterval;
+
+    lastModification = now;
+
+    return burst;
 }
 
 
 
 // -----------------------------------------------------------------------------
-    static void set_bc_indicators_at(
-        ScintillaObject *sci,
-        const BracketColorsData &data,
-        gint index
-    )
+    void BracketColorsData::EndBurst()
+
 /*
-    assign indicator at position, check if already correct
+    move the queues over everything done in the burst, then queue and clear
+    the inserted text like single insertions do
 ----------------------------------------------------------------------------- */
 {
-    for (gint i = 0; i < BracketType::COUNT; i++) {
+    if (burstLog.Empty()) {
+        return;
+    }
 
-        const BracketMap &bracketMap = data.bracketMaps[i];
+    BC_METRICS_SCOPE(TIMER_END_BURST);
 
-        auto it = bracketMap.mBracketMap.find(index);
-        if (it == bracketMap.mBracketMap.end()) {
-            continue;
+    burstLog.Compact();
+    recomputeRanges.Apply(burstLog);
+    redrawRanges.Apply(burstLog);
+
+    ScintillaObject *sci = doc->editor->sci;
+    for (const EditLog::Change &change : burstLog.mChanges) {
+        if (change.length > 0) {
+            // a net change can join insertions next to different brackets,
+            // so one position does not say what it picked up
+            painter.ClearRange(sci, change.current, change.length);
+            recomputeRanges.Add(change.current, change.current + change.length);
         }
+    }
 
-        auto bracket = it->second;
+    burstLog.Clear();
+    queueGrew = TRUE;
+}
 
-        if (BracketMap::GetLength(bracket) != BracketMap::UNDEFINED) {
 
-            std::array<gint, 2> positions {
-                { index, index + BracketMap::GetLength(bracket) }
-            };
 
-            for (auto position : positions) {
+// -----------------------------------------------------------------------------
+    void BracketColorsData::Rebuild()
 
-                guint correctIndicatorIndex = sIndicatorIndex + \
-                    ((BracketMap::GetOrder(bracket) + i) % BC_NUM_COLORS);
+/*
+    drop the queues and analyze the whole document again. The bracket map
+    stays until the result replaces it, it still says which indicators are
+    painted.
+----------------------------------------------------------------------------- */
+{
+    BC_METRICS_COUNT(COUNTER_REBUILD);
 
-                gint curr = SSM(sci, SCI_INDICATORVALUEAT, correctIndicatorIndex, position);
-                if (not curr) {
-                    SSM(
-                        sci,
-                        SCI_SETINDICATORCURRENT,
-                        correctIndicatorIndex,
-                        BC_NO_ARG
-                    );
-                    SSM(sci, SCI_INDICATORFILLRANGE, position, 1);
-                }
+    recomputeRanges.Clear();
+    redrawRanges.Clear();
+    queueGrew = FALSE;
+    restored = FALSE;
 
-                // make sure there arent any other indicators at position
-                for (
-                    guint indicatorIndex = sIndicatorIndex;
-                    indicatorIndex < sIndicatorIndex + BC_NUM_COLORS;
-                    indicatorIndex++
-                )
-                {
-                    if (indicatorIndex == correctIndicatorIndex) {
-                        continue;
-                    }
-
-                    gint hasIndicator = SSM(sci, SCI_INDICATORVALUEAT, indicatorIndex, position);
-                    if (hasIndicator) {
-                        SSM(
-                            sci,
-                            SCI_SETINDICATORCURRENT,
-                            indicatorIndex,
-                            BC_NO_ARG
-                        );
-                        SSM(sci, SCI_INDICATORCLEARRANGE, position, 1);
-                    }
-                }
-            }
-        }
-    }
+    init = FALSE;
 }
 
 
 
+// -----------------------------------------------------------------------------
+    const CodeStyleSet& BracketColorsData::GetCodeStyles()
+
+/*
+    asking geany for every bracket is expensive, so cache which of the 256
+    styles are code for this lexer
+----------------------------------------------------------------------------- */
+{
+    if (not codeStylesValid) {
+        gint lexer = SSM(doc->editor->sci, SCI_GETLEXER, BC_NO_ARG, BC_NO_ARG);
+        for (guint style = 0; style < codeStyles.size(); style++) {
+            codeStyles[style] = highlighting_is_code_style(lexer, style);
+        }
+        codeStylesValid = TRUE;
+    }
+
+    return codeStyles;
+}
+
+
+
+// -----------------------------------------------------------------------------
+    gsize BracketColorsData::MemoryUsage() const
+
+/*
+    bytes used by this document, counting reserved capacity
+----------------------------------------------------------------------------- */
+{
+    return
+        sizeof(*this) +
+        bracketMap.MemoryUsage() +
+        recomputeRanges.MemoryUsage() +
+        redrawRanges.MemoryUsage() +
+        updatedBrackets.capacity() * sizeof(BracketMap::Index) +
+        (editLog.mChanges.capacity() + burstLog.mChanges.capacity()) *
+            sizeof(EditLog::Change) +
+        painter.MemoryUsage() +
+        history.MemoryUsage() +
+        hibernatedMap.capacity() +
+        analysisBytes;
+}
+
+
+
+// -----------------------------------------------------------------------------
+    void BracketColorsData::DropAnalysis()
+
+/*
+    free everything that can be rebuilt, the document is analyzed again the
+    next time it is activated. Indicators already painted stay if they match
+    the text, Wake() clears them if it is edited before then.
+----------------------------------------------------------------------------- */
+{
+    StopTimers();
+
+    // queued work or a stale blob means some indicators are already wrong
+    gboolean settled =
+        init and not analysisPending and
+        editLog.Empty() and burstLog.Empty() and
+        recomputeRanges.Empty() and redrawRanges.Empty() and
+        (not hibernated or generation == hibernatedGeneration);
+
+    if (not settled) {
+        ScintillaObject *sci = doc->editor->sci;
+        painter.ClearRange(sci, 0, SSM(sci, SCI_GETLENGTH, BC_NO_ARG, BC_NO_ARG));
+    }
+
+    dropped = TRUE;
+    droppedGeneration = generation;
+
+    if (analysisPending) {
+        g_cancellable_cancel(analysisCancellable);
+        g_object_unref(analysisCancellable);
+        analysisCancellable = g_cancellable_new();
+        analysisPending = FALSE;
+        analysisBytes = 0;
+    }
+
+    BracketMap emptyMap;
+    bracketMap.Swap(emptyMap);
+    editLog.Clear();
+    burstLog.Clear();
+    std::vector<EditLog::Change>().swap(editLog.mChanges);
+    std::vector<EditLog::Change>().swap(burstLog.mChanges);
+    history.Clear();
+    restored = FALSE;
+
+    recomputeRanges = DirtyRanges();
+    redrawRanges = DirtyRanges(sRedrawMergeDistance);
+    std::vector<BracketMap::Index>().swap(updatedBrackets);
+
+    hibernated = FALSE;
+    std::vector<guint8>().swap(hibernatedMap);
+
+    init = FALSE;
+    updateUI = FALSE;
+}
+
+
+
+// -----------------------------------------------------------------------------
+    void BracketColorsData::Hibernate()
+
+/*
+    document went to the background, keep its brackets as a compact blob and
+    free the bracket map. Queued ranges are small and stay as they are.
+----------------------------------------------------------------------------- */
+{
+    if (hibernated or not init or analysisPending) {
+        return;
+    }
+
+    StopTimers();
+    ApplyEdits();
+    history.Capture(bracketMap);
+    restored = FALSE;
+
+    bracketMap.Encode(hibernatedMap);
+    hibernatedMap.shrink_to_fit();
+    hibernatedGeneration = generation;
+    hibernated = TRUE;
+
+    BracketMap emptyMap;
+    bracketMap.Swap(emptyMap);
+    std::vector<BracketMap::Index>().swap(updatedBrackets);
+}
+
+
+
+// -----------------------------------------------------------------------------
+    void BracketColorsData::Wake()
+
+/*
+    document is active again, decode its brackets. If it was edited in the
+    meantime the blob is useless and the document is analyzed from scratch.
+----------------------------------------------------------------------------- */
+{
+    if (dropped) {
+        dropped = FALSE;
+
+        // there is no map to tell which indicators the edits made stale
+        if (generation != droppedGeneration) {
+            ScintillaObject *sci = doc->editor->sci;
+            painter.ClearRange(sci, 0, SSM(sci, SCI_GETLENGTH, BC_NO_ARG, BC_NO_ARG));
+        }
+    }
+
+    if (not hibernated) {
+        return;
+    }
+
+    hibernated = FALSE;
+
+    if (generation == hibernatedGeneration and bracketMap.Decode(hibernatedMap)) {
+        // indicators were left in place, orders only need to be rebuilt
+        bracketMap.ComputeOrder(updatedBrackets);
+        updatedBrackets.clear();
+    }
+    else {
+        // the map the new analysis replaces is gone, so it cannot say which
+        // of the indicators left in place are stale
+        ScintillaObject *sci = doc->editor->sci;
+        painter.ClearRange(sci, 0, SSM(sci, SCI_GETLENGTH, BC_NO_ARG, BC_NO_ARG));
+
+        bracketMap.Clear();
+        recomputeRanges.Clear();
+        init = FALSE;
+    }
+
+    std::vector<guint8>().swap(hibernatedMap);
+}
+
+
+
+// -----------------------------------------------------------------------------
+    static void assign_indicator_colors(
+        BracketColorsData *data
+    )
+/*
+
+----------------------------------------------------------------------------- */
+{
+    ScintillaObject *sci = data->doc->editor->sci;
+
+    for (guint i = 0; i < gPluginConfiguration.mColors.size(); i++) {
+        guint index = sIndicatorIndex + i;
+        std::string spec = gPluginConfiguration.mColors.at(i);
+        gint color = utils_parse_color_to_bgr(spec.c_str());
+        SSM(sci, SCI_INDICSETSTYLE, index, INDIC_TEXTFORE);
+        SSM(sci, SCI_INDICSETFORE, index, color);
+    }
+}
+
+
+
+// -----------------------------------------------------------------------------
+    static gboolean has_document(void)
+/*
+    sanity check
+----------------------------------------------------------------------------- */
+{
+    GtkNotebook *notebook = GTK_NOTEBOOK(geany_data->main_widgets->notebook);
+    gint currPage = gtk_notebook_get_current_page(notebook);
+    return currPage >= 0 ? TRUE : FALSE;
+}
+
+
+
+// -----------------------------------------------------------------------------
+    static gboolean is_curr_document(
+        BracketColorsData *data
+    )
+/*
+    check if this document is currently opened
+----------------------------------------------------------------------------- */
+{
+    GtkNotebook *notebook = GTK_NOTEBOOK(geany_data->main_widgets->notebook);
+    gint currPage = gtk_notebook_get_current_page(notebook);
+    GeanyDocument *currDoc = document_get_from_page(currPage);
+
+    if (currDoc != NULL and currDoc == data->doc) {
+        return TRUE;
+    }
+
+    return FALSE;
+}
+
+
+
+// -----------------------------------------------------------------------------
+    static void bracket_colors_data_free(gpointer data)
+/*
+
+----------------------------------------------------------------------------- */
+{
+    BracketColorsData *bcd = reinterpret_cast<BracketColorsData *>(data);
+    delete bcd;
+}
+
+
+
+// -----------------------------------------------------------------------------
+    static BracketColorsData* bracket_colors_data_new(GeanyDocument *doc)
+/*
+
+----------------------------------------------------------------------------- */
+{
+    BracketColorsData *newBCD = new BracketColorsData();
+
+    plugin_set_document_data_full(
+        geany_plugin,
+        doc,
+        sPluginName,
+        newBCD,
+        bracket_colors_data_free
+    );
+
+    return newBCD;
+}
+
+
+
+// -----------------------------------------------------------------------------
+    static gboolean is_open_bracket(
+        gchar ch,
+        BracketType type
+    )
+/*
+    check if char is open bracket type
+----------------------------------------------------------------------------- */
+{
+    guint8 bracketClass = bracket_class(ch);
+
+    if (not (bracketClass & BC_CLASS_OPEN)) {
+        return FALSE;
+    }
+
+    if (type == BracketType::COUNT or bracket_class_type(bracketClass) == type) {
+        return TRUE;
+    }
+
+    return FALSE;
+}
+
+
+// -----------------------------------------------------------------------------
+    static gboolean is_ignore_style(
+        BracketColorsData &data,
+        gint position
+    )
+/*
+    check if position is part of non source section
+----------------------------------------------------------------------------- */
+{
+    ScintillaObject *sci = data.doc->editor->sci;
+    guint8 style = SSM(sci, SCI_GETSTYLEAT, position, BC_NO_ARG);
+
+    return not data.GetCodeStyles().test(style);
+}
+
+
+
+// -----------------------------------------------------------------------------
+    static gint compute_bracket_at(
+        BracketColorsData &data,
+        BracketType type,
+        gint position,
+        bool updateInvalidMapping = true
+    )
+/*
+    compute bracket at position, the caller has already checked that
+    position itself is in a code style
+    braceIdentity == -1 : unknown start brace
+    braceIdentity == -2 : invalid computation
+----------------------------------------------------------------------------- */
+{
+    ScintillaObject *sci = data.doc->editor->sci;
+    BracketMap &bracketMap = data.bracketMap;
+    gint matchedBrace = SSM(sci, SCI_BRACEMATCH, position, BC_NO_ARG);
+    gint braceIdentity = position;
+
+    if (matchedBrace != -1 and is_ignore_style(data, matchedBrace)) {
+        // https://www.scintilla.org/ScintillaDoc.html#SCI_BRACEMATCH
+        // A match only occurs if the style of the matching brace is the same as
+        // the starting brace or the matching brace is beyond the end of styling.
+        return -2;
+    }
+
+    if (matchedBrace != -1) {
+
+        gint length = matchedBrace - position;
+
+        if (length > 0) {
+            // matched from start brace
+            bracketMap.Update(position, type, length);
+        }
+        else {
+            // matched from end brace
+            length = -length;
+            braceIdentity = position - length;
+            bracketMap.Update(braceIdentity, type, length);
+        }
+    }
+    else {
+        // invalid mapping
+
+        gchar ch = SSM(sci, SCI_GETCHARAT, position, BC_NO_ARG);
+        if (is_open_bracket(ch, BracketType::COUNT)) {
+            if (updateInvalidMapping) {
+                bracketMap.Update(position, type, BracketMap::UNDEFINED);
+            }
+        }
+        else {
+            // unknown start brace
+            braceIdentity = -1;
+        }
+    }
+
+    return braceIdentity;
+}
+
+
+
+
+// -----------------------------------------------------------------------------
+    static std::vector<BracketMap::Index> get_painted_ends(
+        const BracketMap &bracketMap
+    )
+/*
+    sorted positions of the closing brackets of every matched pair
+----------------------------------------------------------------------------- */
+{
+    std::vector<BracketMap::Index> ends;
+    for (gsize i = 0; i < bracketMap.Size(); i++) {
+        BracketMap::Length length = bracketMap.GetLength(i);
+        if (length != BracketMap::UNDEFINED) {
+            ends.push_back(bracketMap.GetPosition(i) + length);
+        }
+    }
+
+    std::sort(ends.begin(), ends.end());
+    return ends;
+}
+
+
+
+#ifdef BC_ENABLE_METRICS
+// -----------------------------------------------------------------------------
+    static void check_stale_ends(
+        BracketColorsData &data,
+        const std::vector<BracketMap::Index> &staleEnds
+    )
+/*
+    every closing bracket clear_stale_indicators() cleared must be bare now,
+    count and report those that are not
+----------------------------------------------------------------------------- */
+{
+    ScintillaObject *sci = data.doc->editor->sci;
+    guint32 ourIndicators = ((1u << BC_NUM_COLORS) - 1) << sIndicatorIndex;
+
+    for (BracketMap::Index position : staleEnds) {
+        guint32 current = SSM(sci, SCI_INDICATORALLONFOR, position, BC_NO_ARG);
+        if (current & ourIndicators) {
+            BC_METRICS_COUNT(COUNTER_STALE_INDICATOR);
+            g_warning("%s: stale indicator left at %d", sPluginName, position);
+        }
+    }
+}
+#endif
+
+
+
+// -----------------------------------------------------------------------------
+    static void clear_stale_indicators(
+        BracketColorsData &data,
+        const BracketMap &newMap
+    )
+/*
+    clear brackets of the current map which are gone or unmatched in newMap.
+    Both are in the current text, so this is a merge of two sorted lists.
+    A pair that changed also leaves its closing bracket painted, which is
+    cleared unless newMap paints it.
+----------------------------------------------------------------------------- */
+{
+    const BracketMap &oldMap = data.bracketMap;
+    if (oldMap.Size() == 0) {
+        return;
+    }
+
+    std::vector<BracketMap::Index> newEnds = get_painted_ends(newMap);
+    std::vector<BracketMap::Index> staleEnds;
+
+    gsize newIndex = 0;
+    for (gsize i = 0; i < oldMap.Size(); i++) {
+        BracketMap::Index position = oldMap.GetPosition(i);
+        BracketMap::Length length = oldMap.GetLength(i);
+        while (newIndex < newMap.Size() and newMap.GetPosition(newIndex) < position) {
+            newIndex++;
+        }
+
+        gboolean samePosition =
+            newIndex < newMap.Size() and newMap.GetPosition(newIndex) == position;
+
+        if (not samePosition or newMap.GetLength(newIndex) == BracketMap::UNDEFINED) {
+            data.painter.Clear(position);
+        }
+
+        if (
+            length == BracketMap::UNDEFINED or
+            (samePosition and newMap.GetLength(newIndex) == length)
+        )
+        {
+            continue;
+        }
+
+        // the old closing bracket, it may still be an end or start in newMap
+        BracketMap::Index endPos = position + length;
+        gsize endIndex = newMap.LowerBound(endPos);
+        gboolean painted =
+            std::binary_search(newEnds.begin(), newEnds.end(), endPos) or (
+                endIndex < newMap.Size() and
+                newMap.GetPosition(endIndex) == endPos and
+                newMap.GetLength(endIndex) != BracketMap::UNDEFINED
+            );
+
+        if (not painted) {
+            data.painter.Clear(endPos);
+            staleEnds.push_back(endPos);
+        }
+    }
+
+    data.painter.Flush(data.doc->editor->sci);
+
+#ifdef BC_ENABLE_METRICS
+    check_stale_ends(data, staleEnds);
+#endif
+}
+
+
+
+// -----------------------------------------------------------------------------
+    static void install_bracket_map(
+        BracketColorsData &data,
+        BracketMap &bracketMap
+    )
+/*
+    take over a map of the current text and queue the whole document for
+    redraw, the painter only sends what differs from the current indicators
+----------------------------------------------------------------------------- */
+{
+    // after a rebuild or an undo the old map still knows what is painted
+    clear_stale_indicators(data, bracketMap);
+
+    data.bracketMap.Swap(bracketMap);
+    data.cacheStored = FALSE;
+
+    // the new map already has every logged edit in it
+    data.editLog.Clear();
+
+    ScintillaObject *sci = data.doc->editor->sci;
+    data.redrawRanges.Add(0, SSM(sci, SCI_GETLENGTH, BC_NO_ARG, BC_NO_ARG));
+
+    data.init = TRUE;
+    data.updateUI = TRUE;
+}
+
+
+
+// -----------------------------------------------------------------------------
+    static void apply_analysis(
+        BracketColorsData &data,
+        BracketAnalysis &analysis
+    )
+/*
+    take over the map of a finished analysis
+----------------------------------------------------------------------------- */
+{
+    install_bracket_map(data, analysis.mBracketMap);
+}
+
+
+
+// -----------------------------------------------------------------------------
+    static void restore_bracket_map(
+        BracketColorsData &data,
+        const std::vector<guint8> &blob
+    )
+/*
+    undo or redo took the text back to what blob was saved for. Put its
+    brackets back instead of recomputing everything the action touched.
+----------------------------------------------------------------------------- */
+{
+    BracketMap restoredMap;
+    if (not restoredMap.Decode(blob)) {
+        return;
+    }
+
+    BC_METRICS_COUNT(COUNTER_RESTORE);
+
+    // stale indicators are found with the current map, in the current text
+    data.ApplyEdits();
+
+    restoredMap.ComputeOrder(data.updatedBrackets);
+    data.updatedBrackets.clear();
+
+    install_bracket_map(data, restoredMap);
+
+    // the saved map was done with its text, nothing the action queued is
+    // left to do
+    data.recomputeRanges.Clear();
+    data.restored = TRUE;
+}
+
+
+
+// -----------------------------------------------------------------------------
+    static void match_all_brackets(
+        BracketColorsData &data
+    )
+/*
+    pair every bracket in the document with a single pass instead of
+    queueing each one for SCI_BRACEMATCH, blocking the main thread
+----------------------------------------------------------------------------- */
+{
+    BC_METRICS_SCOPE(TIMER_ANALYSIS);
+
+    BracketAnalysis analysis;
+    analysis.Capture(
+        data.doc->editor->sci, data.generation,
+        data.GetCodeStyles(), data.bracketColorsEnable
+    );
+    analysis.mParallelMinSize = gPluginConfiguration.mParallelMinSize;
+    analysis.Run();
+
+    apply_analysis(data, analysis);
+    enforce_memory_budget();
+}
+
+
+
+// -----------------------------------------------------------------------------
+    static void analysis_thread(
+        GTask *task,
+        gpointer sourceObject,
+        gpointer taskData,
+        GCancellable *cancellable
+    )
+/*
+    worker thread, only touches the snapshot
+----------------------------------------------------------------------------- */
+{
+    if (not g_cancellable_is_cancelled(cancellable)) {
+        reinterpret_cast<BracketAnalysis *>(taskData)->Run();
+    }
+
+    g_task_return_boolean(task, TRUE);
+}
+
+
+
+// -----------------------------------------------------------------------------
+    static void analysis_free(
+        gpointer data
+    )
+/*
+
+----------------------------------------------------------------------------- */
+{
+    delete reinterpret_cast<BracketAnalysis *>(data);
+}
+
+
+
+// -----------------------------------------------------------------------------
+    static void analysis_ready(
+        GObject *sourceObject,
+        GAsyncResult *result,
+        gpointer user_data
+    )
+/*
+    back on the main thread. Results are thrown away if the document data
+    is gone or the document was edited since the snapshot was taken.
+----------------------------------------------------------------------------- */
+{
+    GTask *task = G_TASK(result);
+
+    // cancelled when the document data was freed, user_data is dangling
+    if (g_cancellable_is_cancelled(g_task_get_cancellable(task))) {
+        return;
+    }
+
+    BracketColorsData *data = reinterpret_cast<BracketColorsData *>(user_data);
+    BracketAnalysis *analysis = reinterpret_cast<BracketAnalysis *>(
+        g_task_get_task_data(task)
+    );
+
+    data->analysisPending = FALSE;
+    data->analysisBytes = 0;
+
+    if (analysis->mGeneration == data->generation) {
+        apply_analysis(*data, *analysis);
+        enforce_memory_budget();
+        data->ScheduleDraw();
+    }
+
+    // stale results start over from a fresh snapshot
+    data->ScheduleCompute();
+}
+
+
+
+// -----------------------------------------------------------------------------
+    static void start_background_analysis(
+        BracketColorsData &data
+    )
+/*
+    snapshot the document and analyze it on a worker thread
+----------------------------------------------------------------------------- */
+{
+    BracketAnalysis *analysis = new BracketAnalysis();
+    analysis->Capture(
+        data.doc->editor->sci, data.generation,
+        data.GetCodeStyles(), data.bracketColorsEnable
+    );
+    analysis->mParallelMinSize = gPluginConfiguration.mParallelMinSize;
+
+    data.analysisBytes = analysis->MemoryUsage();
+
+    GTask *task = g_task_new(NULL, data.analysisCancellable, analysis_ready, &data);
+    g_task_set_task_data(task, analysis, analysis_free);
+    g_task_run_in_thread(task, analysis_thread);
+    g_object_unref(task);
+
+    data.analysisPending = TRUE;
+
+    // the snapshot already covers everything queued so far, restyling from
+    // now on is queued and picked up once the result is applied
+    data.recomputeRanges.Clear();
+}
+
+
+
+// -----------------------------------------------------------------------------
+    static void remove_bc_indicators(
+        ScintillaObject *sci
+    )
+/*
+    remove indicators associated with this plugin
+----------------------------------------------------------------------------- */
+{
+    gint length = SSM(sci, SCI_GETLENGTH, BC_NO_ARG, BC_NO_ARG);
+    for (gint i = 0; i < BC_NUM_COLORS; i++) {
+        SSM(sci, SCI_SETINDICATORCURRENT, sIndicatorIndex + i, BC_NO_ARG);
+        SSM(sci, SCI_INDICATORCLEARRANGE, 0, length);
+    }
+}
+
+
+
+// -----------------------------------------------------------------------------
+    static void set_bc_indicators_for(
+        BracketColorsData &data,
+        gsize index
+    )
+/*
+    queue indicator at both ends of bracket, painter skips ones already correct
+----------------------------------------------------------------------------- */
+{
+    const BracketMap &bracketMap = data.bracketMap;
+    BracketMap::Length length = bracketMap.GetLength(index);
+
+    if (length != BracketMap::UNDEFINED) {
+
+        gint position = bracketMap.GetPosition(index);
+        std::array<gint, 2> positions {
+            { position, position + length }
+        };
+
+        guint correctIndicatorIndex = sIndicatorIndex + \
+            ((bracketMap.GetOrder(index) + bracketMap.GetType(index)) % BC_NUM_COLORS);
+
+        for (auto endPosition : positions) {
+            data.painter.Paint(endPosition, correctIndicatorIndex);
+        }
+    }
+}
+
+
 
 // -----------------------------------------------------------------------------
     static void clear_bc_indicators(
-        ScintillaObject *sci,
+        BracketColorsData &data,
         gint position, gint length
     )
 /*
-    clear bracket indicators in range
+    clear bracket indicators inserted text picked up from its neighbours
+----------------------------------------------------------------------------- */
+{
+    ScintillaObject *sci = data.doc->editor->sci;
+    data.painter.ClearInserted(sci, position, length);
+}
+
+
+
+// -----------------------------------------------------------------------------
+    static gint64 next_tick_budget(
+        gint64 current,
+        const WorkBudget &budget,
+        gboolean workRemaining
+    )
+/*
+    while we are falling behind and the user is idle, double the budget so
+    cheap work goes out in bigger batches. Drop back to the base budget as
+    soon as input shows up or the queue drains.
+----------------------------------------------------------------------------- */
+{
+    if (budget.YieldedToInput() or not workRemaining) {
+        return sBaseTickBudget;
+    }
+
+    return std::min(current * 2, sMaxTickBudget);
+}
+
+
+
+// -----------------------------------------------------------------------------
+    static guint render_range(
+        BracketColorsData *data,
+        gint start, gint end,
+        WorkBudget &budget
+    )
+/*
+    paint brackets of queued ranges in [start, end), returns number painted
+----------------------------------------------------------------------------- */
+{
+    guint numRendered = 0;
+
+    DirtyRanges::Range range;
+    while (
+        not budget.Expired() and
+        data->redrawRanges.First(start, end, range)
+    )
+    {
+        gint pieceEnd = std::min(range.second, range.first + sWorkPieceSize);
+
+        const BracketMap &bracketMap = data->bracketMap;
+
+        for (
+            gsize i = bracketMap.LowerBound(range.first);
+            i < bracketMap.Size() and bracketMap.GetPosition(i) < pieceEnd;
+            i++
+        )
+        {
+            // if this bracket has been reinserted into the work queue, ignore
+            if (not data->recomputeRanges.Contains(bracketMap.GetPosition(i))) {
+                set_bc_indicators_for(*data, i);
+                numRendered++;
+            }
+        }
+
+        data->redrawRanges.Remove(range.first, pieceEnd);
+    }
+
+    return numRendered;
+}
+
+
+
+// -----------------------------------------------------------------------------
+    static void render_document(
+        ScintillaObject *sci,
+        BracketColorsData *data
+    )
+/*
+    everything on screen is painted right away, the rest of the document is
+    filled in progressively
+----------------------------------------------------------------------------- */
+{
+    BC_METRICS_SCOPE(TIMER_RENDER);
+
+    data->EndBurst();
+
+    // positions are stale until the next compute tick applies the edit log
+    if (data->updateUI and data->editLog.Empty()) {
+
+        WorkBudget visibleBudget(WorkBudget::UNLIMITED);
+        render_range(data, data->visibleStart, data->visibleEnd, visibleBudget);
+
+        WorkBudget budget(data->drawBudget);
+        render_range(data, 0, G_MAXINT, budget);
+
+        data->painter.Flush(sci);
+
+        if (data->redrawRanges.Empty()) {
+            data->updateUI = FALSE;
+        }
+
+        data->drawBudget = next_tick_budget(
+            data->drawBudget, budget, not data->redrawRanges.Empty()
+        );
+    }
+}
+
+
+
+// -----------------------------------------------------------------------------
+    static void record_modification(
+        BracketColorsData *data,
+        SCNotification *nt
+    )
+/*
+    append a modification to the trace of this document
+----------------------------------------------------------------------------- */
+{
+    TraceRecorder &recorder = data->traceRecorder;
+
+    if ((nt->modificationType & SC_MOD_INSERTTEXT) and nt->text != NULL) {
+        recorder.RecordInsert(nt->position, nt->text, nt->length);
+    }
+
+    if (nt->modificationType & SC_MOD_DELETETEXT) {
+        recorder.RecordDelete(nt->position, nt->length);
+    }
+
+    if (nt->modificationType & SC_MOD_CHANGESTYLE) {
+        std::vector<guint8> styles;
+        BracketScanner scanner(data->doc->editor->sci);
+        scanner.GetStyles(nt->position, nt->position + nt->length, styles);
+        recorder.RecordStyle(nt->position, styles.data(), nt->length);
+    }
+}
+
+
+
+// -----------------------------------------------------------------------------
+    static gboolean is_settled(
+        const BracketColorsData &data
+    )
+/*
+    the bracket map is done with the current text
+----------------------------------------------------------------------------- */
+{
+    return
+        data.init and
+        not data.hibernated and
+        data.editLog.Empty() and
+        data.burstLog.Empty() and
+        data.recomputeRanges.Empty();
+}
+
+
+
+// -----------------------------------------------------------------------------
+    static void track_undo_action(
+        BracketColorsData &data,
+        SCNotification *nt
+    )
+/*
+    follow the undo actions of the document for BracketHistory, called for
+    every insertion and deletion before we handle it
+----------------------------------------------------------------------------- */
+{
+    BracketHistory &history = data.history;
+    gint modificationType = nt->modificationType;
+
+    if (modificationType & SC_PERFORMED_USER) {
+        // typing keeps extending the action it started
+        if (modificationType & SC_STARTACTION) {
+            history.Capture(data.bracketMap);
+            history.Begin(BracketHistory::USER, is_settled(data));
+        }
+        else if (not history.mOpen) {
+            // part of an action we did not see begin, so undo can no
+            // longer be matched up
+            history.Clear();
+        }
+    }
+    else if (not history.mOpen or history.mKind == BracketHistory::USER) {
+        history.Capture(data.bracketMap);
+        history.Begin(
+            (modificationType & SC_PERFORMED_UNDO) ?
+                BracketHistory::UNDO : BracketHistory::REDO,
+            is_settled(data)
+        );
+    }
+
+    history.Step(
+        (modificationType & SC_MOD_INSERTTEXT) != 0, nt->position, nt->length
+    );
+}
+
+
+
+// -----------------------------------------------------------------------------
+    static void end_undo_action(
+        BracketColorsData &data
+    )
+/*
+    last step of an undo or redo, restore the map saved for the text it
+    went back to if there is one
+----------------------------------------------------------------------------- */
+{
+    // the map from before the undo, for redoing it
+    data.history.Capture(data.bracketMap);
+
+    std::vector<guint8> blob;
+    if (data.history.End(blob) and data.init and not data.hibernated) {
+        restore_bracket_map(data, blob);
+    }
+}
+
+
+
+// -----------------------------------------------------------------------------
+    static void verify_restyled_range(
+        BracketColorsData &data,
+        gint start, gint end
+    )
+/*
+    after a restore the text is what the map was saved for, so restyling
+    mostly brings back the styles it was computed with. Instead of queueing
+    the whole range, only queue brackets whose code style disagrees with
+    the map.
+----------------------------------------------------------------------------- */
+{
+    const BracketMap &bracketMap = data.bracketMap;
+    const CodeStyleSet &codeStyles = data.GetCodeStyles();
+
+    BracketScanner scanner(data.doc->editor->sci);
+    std::vector<guint8> styles;
+    scanner.GetStyles(start, end, styles);
+
+    scanner.ForEachSlice(start, end,
+        [&](const gchar *text, gint position, gint length) {
+            for (gint i = 0; i < length; i++) {
+                guint8 bracketClass = bracket_class(text[i]);
+                if (not (bracketClass & BC_CLASS_BRACKET)) {
+                    continue;
+                }
+
+                BracketType type = bracket_class_type(bracketClass);
+                if (data.bracketColorsEnable[type] == FALSE) {
+                    continue;
+                }
+
+                gboolean code = codeStyles.test(styles[position + i - start]);
+                gboolean mapped = bracketMap.Find(position + i) != BracketMap::NPOS;
+                if (code != mapped) {
+                    data.recomputeRanges.Add(position + i);
+                }
+            }
+        }
+    );
+}
+
+
+
+// -----------------------------------------------------------------------------
+    static void on_sci_notify(
+        ScintillaObject *sci,
+        gint scn,
+        SCNotification *nt,
+        gpointer user_data
+    )
+/*
+
 ----------------------------------------------------------------------------- */
 {
-    for (gint i = position; i < position + length; i++) {
-        for (
-            guint indicatorIndex = sIndicatorIndex;
-            indicatorIndex < sIndicatorIndex + BC_NUM_COLORS;
-            indicatorIndex++
-        )
+    BC_METRICS_SCOPE(TIMER_SCI_NOTIFY);
+
+    BracketColorsData *data = reinterpret_cast<BracketColorsData *>(user_data);
+
+    switch(nt->nmhdr.code) {
+
+        case(SCN_UPDATEUI): {
+
+            // back in the main loop, whatever came before is over
+            data->EndBurst();
+
+            if (nt->updated & SC_UPDATE_V_SCROLL) {
+
+                if (data->init and is_curr_document(data)) {
+                    update_visible_range(data);
+                    recompute_visible_range(data);
+                }
+            }
+
+            if (nt->updated & (SC_UPDATE_CONTENT | SC_UPDATE_V_SCROLL)) {
+
+                if (is_curr_document(data)) {
+                    render_document(sci, data);
+                }
+            }
+
+            break;
+        }
+
+        case(SCN_MODIFIED):
         {
-            gint hasIndicator = SSM(sci, SCI_INDICATORVALUEAT, indicatorIndex, i);
-            if (hasIndicator) {
-                SSM(
-                    sci,
-                    SCI_SETINDICATORCURRENT,
-                    indicatorIndex,
-                    BC_NO_ARG
-                );
-                SSM(sci, SCI_INDICATORCLEARRANGE, i, 1);
+            if (data->traceRecorder.IsOpen()) {
+                record_modification(data, nt);
+            }
+
+            if (nt->modificationType & (SC_MOD_INSERTTEXT | SC_MOD_DELETETEXT)) {
+                data->generation++;
+                data->restored = FALSE;
+                data->cacheStored = FALSE;
+                track_undo_action(*data, nt);
+            }
+
+            gboolean burst =
+                (nt->modificationType & (SC_MOD_INSERTTEXT | SC_MOD_DELETETEXT)) and
+                data->InBurst(nt->modificationType);
+
+            if (nt->modificationType & SC_MOD_INSERTTEXT) {
+
+                if (burst) {
+                    data->burstLog.Insert(nt->position, nt->length);
+                }
+                else {
+                    // if we insert into position that had bracket
+                    clear_bc_indicators(*data, nt->position, nt->length);
+
+                    data->ShiftQueues(nt->position, nt->length);
+                    data->recomputeRanges.Add(nt->position, nt->position + nt->length);
+                    data->queueGrew = TRUE;
+                }
+
+                // brackets are moved on the next tick, see ApplyEdits()
+                if (data->bracketMap.Size() > 0) {
+                    data->editLog.Insert(nt->position, nt->length);
+                }
+            }
+
+            if (nt->modificationType & SC_MOD_DELETETEXT) {
+
+                if (burst) {
+                    data->burstLog.Delete(nt->position, nt->length);
+                }
+                else {
+                    data->ShiftQueues(nt->position + nt->length, -nt->length);
+                }
+
+                if (data->bracketMap.Size() > 0) {
+                    data->editLog.Delete(nt->position, nt->length);
+                }
+            }
+
+            // mapping through a long log gets slow, catch up instead
+            if (data->editLog.Full()) {
+                data->ApplyEdits();
+            }
+            if (data->burstLog.Full() or (nt->modificationType & SC_LASTSTEPINUNDOREDO)) {
+                data->EndBurst();
+            }
+
+            if (
+                (nt->modificationType & (SC_MOD_INSERTTEXT | SC_MOD_DELETETEXT)) and
+                (nt->modificationType & SC_LASTSTEPINUNDOREDO)
+            )
+            {
+                end_undo_action(*data);
+            }
+
+            if (nt->modificationType & SC_MOD_CHANGESTYLE) {
+
+                data->EndBurst();
+
+                if (data->restored) {
+                    verify_restyled_range(*data, nt->position, nt->position + nt->length);
+                    data->queueGrew = TRUE;
+                }
+                else if (data->init or data->analysisPending) {
+                    data->recomputeRanges.Add(
+                        nt->position, nt->position + nt->length
+                    );
+                    data->queueGrew = TRUE;
+                }
             }
+
+            break;
         }
     }
+
+    // only wake up when there is queued work, sources of inactive
+    // documents don't exist so this is a no-op for them
+    if (
+        not data->recomputeRanges.Empty() or
+        not data->editLog.Empty() or
+        not data->burstLog.Empty()
+    ) {
+        data->ScheduleCompute();
+    }
+    if (data->updateUI) {
+        data->ScheduleDraw();
+    }
 }
 
 
 
 // -----------------------------------------------------------------------------
-    static gboolean move_brackets(
-        ScintillaObject *sci,
-        BracketColorsData &bracketColorsData,
-        gint position, gint length,
-        BracketType type
+    gboolean render_brackets_timeout(
+        gpointer user_data
     )
 /*
-    handle when text is added
+
 ----------------------------------------------------------------------------- */
 {
-    if (bracketColorsData.bracketColorsEnable[type] == FALSE) {
+    if (not has_document()) {
+        // stay dormant, the source belongs to our document data
+        return TRUE;
+    }
+
+    BracketColorsData *data = reinterpret_cast<BracketColorsData *>(user_data);
+
+    if (not is_curr_document(data)) {
+        data->StopTimers();
         return FALSE;
     }
 
-    BracketMap &bracketMap = bracketColorsData.bracketMaps[type];
+    if (data->updateUI) {
+        render_document(data->doc->editor->sci, data);
+    }
 
-    std::set<BracketMap::Index> indiciesToAdjust, indiciesToRecompute;
+    if (data->updateUI) {
+        data->ScheduleDraw();
+    }
 
-    /*
-     * Look through existing bracket map and check if addition of characters
-     * will require adjustment
-     */
+    return TRUE;
+}
+
+
+
+// -----------------------------------------------------------------------------
+    static void check_background_color(
+        BracketColorsData *data
+    )
+/*
+    pick the default color set matching the background, called when the
+    color scheme can have changed instead of polling for it
+----------------------------------------------------------------------------- */
+{
+    ScintillaObject *sci = data->doc->editor->sci;
+    guint32 currBGColor = SSM(sci, SCI_STYLEGETBACK, STYLE_DEFAULT, BC_NO_ARG);
+    if (currBGColor != data->backgroundColor) {
+        gboolean currDark = utils_is_dark(currBGColor);
+        gboolean wasDark = utils_is_dark(data->backgroundColor);
+        if (currDark != wasDark and gPluginConfiguration.mUseDefaults) {
+            gPluginConfiguration.mColors = currDark ? sDarkBackgroundColors : sLightBackgroundColors;
+            assign_indicator_colors(data);
+        }
+
+        data->backgroundColor = currBGColor;
+    }
+}
+
+
+
+// -----------------------------------------------------------------------------
+    static void update_visible_range(
+        BracketColorsData *data
+    )
+/*
+    find the document positions covered by the lines on screen
+----------------------------------------------------------------------------- */
+{
+    ScintillaObject *sci = data->doc->editor->sci;
+
+    gint firstVisible = SSM(sci, SCI_GETFIRSTVISIBLELINE, BC_NO_ARG, BC_NO_ARG);
+    gint linesOnScreen = SSM(sci, SCI_LINESONSCREEN, BC_NO_ARG, BC_NO_ARG);
+
+    gint firstLine = SSM(sci, SCI_DOCLINEFROMVISIBLE, firstVisible, BC_NO_ARG);
+    gint lastLine = SSM(
+        sci, SCI_DOCLINEFROMVISIBLE, firstVisible + linesOnScreen, BC_NO_ARG
+    );
+
+    data->visibleStart = SSM(sci, SCI_POSITIONFROMLINE, firstLine, BC_NO_ARG);
+
+    gint visibleEnd = SSM(sci, SCI_POSITIONFROMLINE, lastLine + 1, BC_NO_ARG);
+    data->visibleEnd = visibleEnd >= 0 ?
+        visibleEnd :
+        SSM(sci, SCI_GETLENGTH, BC_NO_ARG, BC_NO_ARG);
+}
 
-    for (const auto &it : bracketMap.mBracketMap) {
-        const auto &bracket = it.second;
-        gint endPos = it.first + BracketMap::GetLength(bracket);
-        if (it.first >= position) {
-            indiciesToAdjust.insert(it.first);
+
+
+// -----------------------------------------------------------------------------
+    static void recompute_bracket(
+        BracketColorsData *data,
+        BracketMap::Index position,
+        std::vector<BracketMap::Index> &recomputedPositions,
+        gboolean &recalculate
+    )
+/*
+    recompute a single queued position
+----------------------------------------------------------------------------- */
+{
+    ScintillaObject *sci = data->doc->editor->sci;
+    BracketMap &bracketMap = data->bracketMap;
+
+    gchar ch = SSM(sci, SCI_GETCHARAT, position, BC_NO_ARG);
+    guint8 bracketClass = bracket_class(ch);
+    if (not (bracketClass & BC_CLASS_BRACKET)) {
+        return;
+    }
+
+    BracketType type = bracket_class_type(bracketClass);
+    if (data->bracketColorsEnable[type] == FALSE) {
+        return;
+    }
+
+    // check if in a comment
+    if (is_ignore_style(*data, position)) {
+        // check if the closing bracket in a comment needs to be cleared
+        gsize index = bracketMap.Find(position);
+        if (index != BracketMap::NPOS) {
+            auto length = bracketMap.GetLength(index);
+            if (length != BracketMap::UNDEFINED) {
+                data->painter.Clear(position + length);
+            }
+            bracketMap.Erase(position);
+        }
+        data->painter.Clear(position);
+    }
+    else {
+        gint brace = compute_bracket_at(*data, type, position);
+        recomputedPositions.push_back(position);
+        if (brace >= 0) {
+            data->redrawRanges.Add(brace);
+        }
+        else if (brace == -2) {
+            // Tried to brace match across nonsource which can
+            // have different sylings. Need to redo computations
+            recalculate = TRUE;
+        }
+        data->updateUI = TRUE;
+    }
+}
+
+
+
+// -----------------------------------------------------------------------------
+    static guint recompute_range(
+        BracketColorsData *data,
+        gint start, gint end,
+        WorkBudget &budget,
+        std::vector<BracketMap::Index> &recomputedPositions,
+        gboolean &recalculate
+    )
+/*
+    recompute brackets of queued ranges in [start, end), returns number
+    processed
+----------------------------------------------------------------------------- */
+{
+    BracketScanner scanner(data->doc->editor->sci);
+    std::vector<BracketHit> hits;
+    guint numIterations = 0;
+
+    DirtyRanges::Range range;
+    while (
+        not budget.Expired() and
+        data->recomputeRanges.First(start, end, range)
+    )
+    {
+        gint pieceEnd = std::min(range.second, range.first + sWorkPieceSize);
+
+        hits.clear();
+        scanner.ForEachSlice(range.first, pieceEnd,
+            [&](const gchar *text, gint position, gint length) {
+                bracket_scan_block(text, length, position, hits);
+            }
+        );
+
+        data->recomputeRanges.Remove(range.first, pieceEnd);
+
+        for (gsize i = 0; i < hits.size(); i++) {
+            const BracketHit &hit = hits[i];
+
+            // a piece can hold many brackets, what is left of it is queued
+            // again. The first one is always done so every call gets ahead.
+            if (i > 0 and budget.Expired()) {
+                data->recomputeRanges.Add(hit.position, pieceEnd);
+                return numIterations;
+            }
+
+            BracketType type = bracket_class_type(hit.bracketClass);
+            if (data->bracketColorsEnable[type] == TRUE) {
+                recompute_bracket(data, hit.position, recomputedPositions, recalculate);
+                numIterations++;
+            }
+        }
+    }
+
+    return numIterations;
+}
+
+
+
+// -----------------------------------------------------------------------------
+    static void finish_recompute(
+        BracketColorsData *data,
+        const std::vector<BracketMap::Index> &recomputedPositions,
+        gboolean recalculate
+    )
+/*
+    update nesting orders after a batch of recomputes
+----------------------------------------------------------------------------- */
+{
+    data->painter.Flush(data->doc->editor->sci);
+
+    if (recalculate) {
+        // Redo everything we just did since it's likely wrong
+        for (BracketMap::Index position : recomputedPositions) {
+            data->recomputeRanges.Add(position);
         }
-        else if (
-            endPos >= position or
-            BracketMap::GetLength(bracket) == BracketMap::UNDEFINED
-        ) {
-            indiciesToRecompute.insert(it.first);
+    }
+    else {
+        if (data->updateUI) {
+            data->updatedBrackets.clear();
+            data->bracketMap.ComputeOrder(data->updatedBrackets);
+            for (BracketMap::Index position : data->updatedBrackets) {
+                data->redrawRanges.Add(position);
+            }
         }
     }
+}
+
+
+
+// -----------------------------------------------------------------------------
+    static gboolean rebuild_is_cheaper(
+        const BracketColorsData &data
+    )
+/*
+    draining the queue scans every queued character and brace matches every
+    queued bracket, while a rebuild is one pass over the document. Once the
+    queue holds more than the configured percentage of either, rebuild.
+----------------------------------------------------------------------------- */
+{
+    gint threshold = gPluginConfiguration.mRebuildThreshold;
+    if (threshold <= 0) {
+        return FALSE;
+    }
+
+    gsize queuedLength = data.recomputeRanges.Length();
+    if (queuedLength < sMinRebuildWork) {
+        return FALSE;
+    }
+
+    ScintillaObject *sci = data.doc->editor->sci;
+    gsize documentLength = SSM(sci, SCI_GETLENGTH, BC_NO_ARG, BC_NO_ARG);
+    if (queuedLength * 100 > documentLength * threshold) {
+        return TRUE;
+    }
+
+    const BracketMap &bracketMap = data.bracketMap;
+    gsize queuedBrackets = 0;
+    for (const DirtyRanges::Range &range : data.recomputeRanges.mRanges) {
+        queuedBrackets +=
+            bracketMap.LowerBound(range.second) - bracketMap.LowerBound(range.first);
+    }
+
+    return queuedBrackets * 100 > bracketMap.Size() * threshold;
+}
+
+
+
+// -----------------------------------------------------------------------------
+    static void recompute_visible_range(
+        BracketColorsData *data
+    )
+/*
+    after scrolling, finish everything on screen without waiting for the
+    timers so it is colored in the next frame
+----------------------------------------------------------------------------- */
+{
+    data->ApplyEdits();
+
+    std::vector<BracketMap::Index> recomputedPositions;
+    gboolean recalculate = FALSE;
+
+    WorkBudget budget(WorkBudget::UNLIMITED);
+    recompute_range(
+        data,
+        data->visibleStart, data->visibleEnd,
+        budget,
+        recomputedPositions, recalculate
+    );
+
+    finish_recompute(data, recomputedPositions, recalculate);
+}
+
+
+
+// -----------------------------------------------------------------------------
+    gboolean recompute_brackets_timeout(
+        gpointer user_data
+    )
+/*
+
+----------------------------------------------------------------------------- */
+{
+    if (not has_document()) {
+        // stay dormant, the source belongs to our document data
+        return TRUE;
+    }
 
-    gboolean madeChange = FALSE;
+    BC_METRICS_SCOPE(TIMER_RECOMPUTE);
 
-    // Check if the new characters that are added were brackets
-    for (gint i = position; i < position + length; i++) {
-        gchar newChar = sci_get_char_at(sci, i);
-        if (is_bracket_type(newChar, type)) {
-            madeChange = TRUE;
-            indiciesToRecompute.insert(i);
+    BracketColorsData *data = reinterpret_cast<BracketColorsData *>(user_data);
+    if (not is_curr_document(data)) {
+        data->StopTimers();
+        return FALSE;
+    }
+
+    data->ApplyEdits();
+
+    if (data->init and data->queueGrew) {
+        data->queueGrew = FALSE;
+        if (rebuild_is_cheaper(*data)) {
+            data->Rebuild();
+        }
+    }
+
+    if (data->init == FALSE) {
+        if (gPluginConfiguration.mBackgroundAnalysis) {
+            // analysis_ready() wakes us up again
+            if (not data->analysisPending) {
+                start_background_analysis(*data);
+            }
+            return TRUE;
         }
+
+        update_visible_range(data);
+        match_all_brackets(*data);
     }
 
-    if (not indiciesToAdjust.size() and not indiciesToRecompute.size()) {
-        return madeChange;
+    if (data->recomputeRanges.Empty()) {
+        if (data->updateUI) {
+            data->ScheduleDraw();
+        }
+        return TRUE;
     }
 
-    bracketColorsData.recomputeIndicies.insert(
-        indiciesToRecompute.begin(), indiciesToRecompute.end()
-    );
-
-    std::set<BracketMap::Index> newIndicies;
-    auto origBracketMap = bracketMap.mBracketMap;
+    update_visible_range(data);
 
-    for (const auto &it : indiciesToAdjust) {
-
-        /*
-         * Move bracket, remove old position
-         */
+    // If we encounter an error computing the brace due to styles changing
+    // it can through off the color orders for entire blocks. If this happens,
+    // just redo the computations which will get fixed once styling settles.
+    std::vector<BracketMap::Index> recomputedPositions;
+    gboolean recalculate = FALSE;
 
-        gint newIndex = it + length;
+    /*
+     * Work on what is on screen first, then continue through the rest of the
+     * document starting below the visible range
+     */
 
-        newIndicies.insert(newIndex);
-        bracketMap.mBracketMap.insert_or_assign(
-            newIndex,
-            origBracketMap.at(it)
+    const std::array<std::pair<gint, gint>, 3> ranges { {
+        { data->visibleStart, data->visibleEnd },
+        { data->visibleEnd, G_MAXINT },
+        { 0, data->visibleStart }
+    } };
+
+    WorkBudget budget(data->computeBudget);
+    for (const auto &range : ranges) {
+        recompute_range(
+            data,
+            range.first, range.second,
+            budget,
+            recomputedPositions, recalculate
         );
+    }
 
-        // dont remove newly added indicies
-        if (newIndicies.find(it) == newIndicies.end()) {
-            bracketMap.mBracketMap.erase(it);
-        }
+    finish_recompute(data, recomputedPositions, recalculate);
 
-        /*
-         * Check if new bracket was placed into position of old adjusted bracket
-         * that we just deleted. If so, don't remove it from the work queue
-         */
+    data->computeBudget = next_tick_budget(
+        data->computeBudget, budget, not data->recomputeRanges.Empty()
+    );
 
-        if (
-            bracketColorsData.recomputeIndicies.find(it) == \
-                bracketColorsData.recomputeIndicies.end()
-        ) {
-            bracketColorsData.RemoveFromQueues(it);
-        }
+    if (not data->recomputeRanges.Empty()) {
+        data->ScheduleCompute();
+    }
+    if (data->updateUI) {
+        data->ScheduleDraw();
     }
 
     return TRUE;
@@ -713,361 +2166,271 @@
 
 
 // -----------------------------------------------------------------------------
-    static gboolean remove_brackets(
-        ScintillaObject *sci,
-        BracketColorsData &bracketColorsData,
-        gint position, gint length,
-        BracketType type
+    static gsize get_memory_usage(
+        guint *numDocuments
     )
 /*
-    handle when text is removed
+    bytes used by all documents we track
 ----------------------------------------------------------------------------- */
 {
-    if (bracketColorsData.bracketColorsEnable[type] == FALSE) {
-        return FALSE;
+    gsize total = 0;
+    *numDocuments = 0;
+
+    guint i = 0;
+    foreach_document(i)
+    {
+        gpointer pluginData = plugin_get_document_data(geany_plugin, documents[i], sPluginName);
+        if (pluginData != NULL) {
+            BracketColorsData *data = reinterpret_cast<BracketColorsData *>(pluginData);
+            total += data->MemoryUsage();
+            (*numDocuments)++;
+        }
     }
 
-    BracketMap &bracketMap = bracketColorsData.bracketMaps[type];
+    return total;
+}
 
-    std::set<BracketMap::Index> indiciesToRemove, indiciesToRecompute, orphanedIndicies;
 
-    for (const auto &it : bracketMap.mBracketMap) {
-        const auto &bracket = it.second;
-        gint endPos = it.first + BracketMap::GetLength(bracket);
-        // start bracket was deleted
-        if ( (it.first >= position) and (it.first < position + length) ) {
-            indiciesToRemove.insert(it.first);
-            // if the end bracket is valid and still present
-            if (endPos > it.first and endPos >= (position + length)) {
-                orphanedIndicies.insert(endPos - length);
-            }
-        }
-        // end bracket removed or space removed
-        else if (
-            it.first >= position or
-            endPos >= position or
-            BracketMap::GetLength(bracket) == BracketMap::UNDEFINED
-        ) {
-            indiciesToRecompute.insert(it.first);
-        }
-    }
 
-    if (
-        not indiciesToRemove.size() and
-        not indiciesToRecompute.size()
-    ) {
-        return FALSE;
+// -----------------------------------------------------------------------------
+    static void enforce_memory_budget(void)
+/*
+    drop analyses of the least recently activated background documents until
+    we fit in the budget. The current document is never dropped.
+----------------------------------------------------------------------------- */
+{
+    if (gPluginConfiguration.mMemoryBudget <= 0) {
+        return;
     }
 
-    for (const auto &it : indiciesToRemove) {
-        bracketMap.mBracketMap.erase(it);
-        bracketColorsData.RemoveFromQueues(it);
-    }
+    gsize budget = gsize(gPluginConfiguration.mMemoryBudget) * 1024 * 1024;
+    std::vector<BracketColorsData *> candidates;
+    gsize total = 0;
 
-    for (const auto &it : indiciesToRecompute) {
-        // first bracket was moved backwards
-        if (it >= position) {
-            bracketMap.mBracketMap.insert_or_assign(
-                it - length,
-                bracketMap.mBracketMap.at(it)
-            );
-            bracketMap.mBracketMap.erase(it);
-            bracketColorsData.RemoveFromQueues(it);
+    guint i = 0;
+    foreach_document(i)
+    {
+        gpointer pluginData = plugin_get_document_data(geany_plugin, documents[i], sPluginName);
+        if (pluginData == NULL) {
+            continue;
         }
-        // last bracket was moved
-        else {
-            bracketColorsData.recomputeIndicies.insert(it);
+
+        BracketColorsData *data = reinterpret_cast<BracketColorsData *>(pluginData);
+
+        total += data->MemoryUsage();
+
+        if ((data->init or data->analysisPending) and not is_curr_document(data)) {
+            candidates.push_back(data);
         }
     }
 
-    // for orphaned end brackets, just recompute them
-    bracketColorsData.recomputeIndicies.insert(
-        orphanedIndicies.begin(), orphanedIndicies.end()
+    std::sort(
+        candidates.begin(), candidates.end(),
+        [](const BracketColorsData *a, const BracketColorsData *b) {
+            return a->lastActivated < b->lastActivated;
+        }
     );
 
-    return TRUE;
+    for (auto it = candidates.begin(); it != candidates.end() and total > budget; it++) {
+        gsize before = (*it)->MemoryUsage();
+        (*it)->DropAnalysis();
+        total -= before - (*it)->MemoryUsage();
+    }
 }
 
 
 
 // -----------------------------------------------------------------------------
-    static void render_document(
-        ScintillaObject *sci,
-        BracketColorsData *data
-    )
+    static void hibernate_inactive_documents(void)
 /*
-
+    compact the bracket maps of documents that are not on screen anymore
 ----------------------------------------------------------------------------- */
 {
-    if (data->updateUI) {
-
-        for (
-            auto position = data->redrawIndicies.begin();
-            position != data->redrawIndicies.end();
-            position++
-        )
-        {
-            // if this bracket has been reinserted into the work queue, ignore
-            if (data->recomputeIndicies.find(*position) == data->recomputeIndicies.end()) {
-                set_bc_indicators_at(sci, *data, *position);
-            }
+    guint i = 0;
+    foreach_document(i)
+    {
+        gpointer pluginData = plugin_get_document_data(geany_plugin, documents[i], sPluginName);
+        if (pluginData == NULL) {
+            continue;
         }
 
-        data->redrawIndicies.clear();
-        data->updateUI = FALSE;
+        BracketColorsData *data = reinterpret_cast<BracketColorsData *>(pluginData);
+        if (not is_curr_document(data)) {
+            data->Hibernate();
+        }
     }
 }
 
 
 
 // -----------------------------------------------------------------------------
-    static void on_sci_notify(
-        ScintillaObject *sci,
-        gint scn,
-        SCNotification *nt,
-        gpointer user_data
+    static BracketCache::Key get_cache_key(
+        BracketColorsData *data
     )
 /*
-
+    what the bracket map of this document depends on
 ----------------------------------------------------------------------------- */
 {
-    BracketColorsData *data = reinterpret_cast<BracketColorsData *>(user_data);
-
-    switch(nt->nmhdr.code) {
-
-        case(SCN_UPDATEUI): {
+    ScintillaObject *sci = data->doc->editor->sci;
 
-            if (nt->updated & SC_UPDATE_CONTENT) {
+    BracketCache::Key key;
+    key.length = SSM(sci, SCI_GETLENGTH, BC_NO_ARG, BC_NO_ARG);
+    key.lexer = SSM(sci, SCI_GETLEXER, BC_NO_ARG, BC_NO_ARG);
 
-                if (is_curr_document(data)) {
-                    render_document(sci, data);
-                }
-            }
+    const gchar *text = reinterpret_cast<const gchar *>(
+        SSM(sci, SCI_GETCHARACTERPOINTER, BC_NO_ARG, BC_NO_ARG)
+    );
+    key.hash = BracketCache::HashContent(text, key.length);
 
-            break;
+    key.enabledTypes = 0;
+    for (guint i = 0; i < BracketType::COUNT; i++) {
+        if (data->bracketColorsEnable[i]) {
+            key.enabledTypes |= 1 << i;
         }
+    }
 
-        case(SCN_MODIFIED):
-        {
-            if (nt->modificationType & SC_MOD_INSERTTEXT) {
+    return key;
+}
 
-                // if we insert into position that had bracket
-                clear_bc_indicators(sci, nt->position, nt->length);
-
-                /*
-                 * Check to adjust current bracket positions
-                 */
-
-                for (gint bracketType = 0; bracketType < BracketType::COUNT; bracketType++) {
-                    if (
-                        move_brackets(
-                            sci,
-                            *data,
-                            nt->position, nt->length,
-                            static_cast<BracketType>(bracketType)
-                        )
-                    ) {
-                        data->updateUI = TRUE;
-                    }
-                }
-            }
 
-            if (nt->modificationType & SC_MOD_DELETETEXT) {
 
-                for (gint bracketType = 0; bracketType < BracketType::COUNT; bracketType++) {
-                    if (
-                        remove_brackets(
-                            sci,
-                            *data,
-                            nt->position, nt->length,
-                            static_cast<BracketType>(bracketType)
-                        )
-                    ) {
-                        data->updateUI = TRUE;
-                    }
-                }
-            }
+// -----------------------------------------------------------------------------
+    static void load_cached_brackets(
+        BracketColorsData *data
+    )
+/*
+    if this exact text was analyzed in an earlier session, take its brackets
+    from the disk cache and just paint them
+----------------------------------------------------------------------------- */
+{
+    if (not gPluginConfiguration.mDiskCache) {
+        return;
+    }
 
-            if (nt->modificationType & SC_MOD_CHANGESTYLE) {
+    BracketCache::Key key = get_cache_key(data);
+    if (not gBracketCache.Load(key, data->bracketMap)) {
+        return;
+    }
 
-                if (data->init == TRUE) {
-                    for (gint bracketType = 0; bracketType < BracketType::COUNT; bracketType++) {
-                        if (data->bracketColorsEnable[bracketType] == FALSE) {
-                            continue;
-                        }
-                        for (gint i = nt->position; i < nt->position + nt->length; i++) {
-                            gchar currChar = sci_get_char_at(sci, i);
-                            if (is_bracket_type(currChar, static_cast<BracketType>(bracketType))) {
-                                data->recomputeIndicies.insert(i);
-                            }
-                        }
-                    }
-                }
-            }
+    data->updatedBrackets.clear();
+    data->bracketMap.ComputeOrder(data->updatedBrackets);
+    data->updatedBrackets.clear();
 
-            break;
-        }
-    }
+    data->redrawRanges.Add(0, key.length);
+    data->init = TRUE;
+    data->updateUI = TRUE;
+    data->cacheStored = TRUE;
+
+    // restyling by the lexer is checked against the map, not recomputed
+    data->restored = TRUE;
 }
 
 
 
 // -----------------------------------------------------------------------------
-    gboolean render_brackets_timeout(
-        gpointer user_data
+    static void store_cached_brackets(
+        BracketColorsData *data,
+        gboolean atShutdown
     )
 /*
-
+    save the brackets of a document that matches the file on disk, so the
+    next session does not have to analyze it again. The key hashes the
+    whole text, so maps already in the cache are not stored again and
+    quitting skips large documents.
 ----------------------------------------------------------------------------- */
 {
-    if (not has_document()) {
-        return FALSE;
-    }
-
-    BracketColorsData *data = reinterpret_cast<BracketColorsData *>(user_data);
+    ScintillaObject *sci = data->doc->editor->sci;
+    data->ApplyEdits();
 
-    if (not is_curr_document(data)) {
-        data->StopTimers();
-        return FALSE;
+    if (
+        not gPluginConfiguration.mDiskCache or
+        data->cacheStored or
+        data->doc->changed or
+        (atShutdown and
+            SSM(sci, SCI_GETLENGTH, BC_NO_ARG, BC_NO_ARG) > sMaxShutdownCacheLength) or
+        not data->init or
+        data->analysisPending or
+        not data->recomputeRanges.Empty()
+    ) {
+        return;
     }
 
-    /*
-     * check if background color changed
-     */
+    std::vector<guint8> blob;
 
-    ScintillaObject *sci = data->doc->editor->sci;
-    guint32 currBGColor = SSM(sci, SCI_STYLEGETBACK, STYLE_DEFAULT, BC_NO_ARG);
-    if (currBGColor != data->backgroundColor) {
-        gboolean currDark = utils_is_dark(currBGColor);
-        gboolean wasDark = utils_is_dark(data->backgroundColor);
-        if (currDark != wasDark and gPluginConfiguration.mUseDefaults) {
-            gPluginConfiguration.mColors = currDark ? sDarkBackgroundColors : sLightBackgroundColors;
-            assign_indicator_colors(data);
+    if (data->hibernated) {
+        if (data->generation != data->hibernatedGeneration) {
+            return;
         }
-
-        data->backgroundColor = currBGColor;
+        blob.swap(data->hibernatedMap);
+        data->hibernated = FALSE;
     }
-
-    if (data->updateUI) {
-        render_document(sci, data);
+    else {
+        data->bracketMap.Encode(blob);
     }
 
-    return TRUE;
+    data->cacheStored = gBracketCache.Store(get_cache_key(data), blob);
 }
 
 
 
 // -----------------------------------------------------------------------------
-    gboolean recompute_brackets_timeout(
-        gpointer user_data
+    static void start_trace(
+        BracketColorsData *data
     )
 /*
-
+    if enabled, record this document and everything done to it so slowdowns
+    can be replayed with bracketcolors_replay
 ----------------------------------------------------------------------------- */
 {
-    static const guint sIterationLimit = 50;
-
-    if (not has_document()) {
-        return FALSE;
-    }
-
-    BracketColorsData *data = reinterpret_cast<BracketColorsData *>(user_data);
-    if (not is_curr_document(data)) {
-        data->StopTimers();
-        return FALSE;
+    if (not gPluginConfiguration.mRecordTraces or data->traceRecorder.IsOpen()) {
+        return;
     }
 
-    if (data->init == FALSE) {
-        find_all_brackets(*data);
-        data->init = TRUE;
-    }
+    gchar *dirname = g_build_filename(
+        geany_data->app->configdir, "plugins", sPluginName, "traces", NULL
+    );
 
-    if (not data->recomputeIndicies.size()) {
-        return TRUE;
+    gint err = utils_mkdir(dirname, TRUE);
+    if (err != 0) {
+        g_warning("Failed to create trace directory \"%s\": %s", dirname, g_strerror(err));
+        g_free(dirname);
+        return;
     }
 
-    ScintillaObject *sci = data->doc->editor->sci;
-
-    // If we encounter an error computing the brace due to styles changing
-    // it can through off the color orders for entire blocks. If this happens,
-    // just redo the computations which will get fixed once styling settles.
-    std::set<BracketMap::Index> recomputedPositions;
-    gboolean recalculate = FALSE;
-
-    guint numIterations = 0;
-    for (
-        auto position = data->recomputeIndicies.begin();
-        position != data->recomputeIndicies.end();
-        numIterations++
-    )
-    {
-        for (gint bracketType = 0; bracketType < BracketType::COUNT; bracketType++) {
+    gchar *basename = data->doc->file_name != NULL ?
+        g_path_get_basename(data->doc->file_name) : g_strdup("untitled");
+    gchar *name = g_strdup_printf(
+        "%s-%" G_GINT64_FORMAT ".bctrace", basename, g_get_real_time()
+    );
+    gchar *filename = g_build_filename(dirname, name, NULL);
 
-            BracketMap &bracketMap = data->bracketMaps[bracketType];
+    if (data->traceRecorder.Open(filename)) {
 
-            if (
-                is_bracket_type(
-                    sci_get_char_at(sci, *position),
-                    static_cast<BracketType>(bracketType)
-                )
-            ) {
-                // check if in a comment
-                if (is_ignore_style(sci, *position)) {
-                    // check if the closing bracket in a comment needs to be cleared
-                    auto it = bracketMap.mBracketMap.find(*position);
-                    if (it != bracketMap.mBracketMap.end()) {
-                        auto length = BracketMap::GetLength(it->second);
-                        if (length != BracketMap::UNDEFINED) {
-                            clear_bc_indicators(sci, (*position) + length, 1);
-                        }
-                        bracketMap.mBracketMap.erase(it->first);
-                    }
-                    clear_bc_indicators(sci, *position, 1);
-                }
-                else {
-                    gint brace = compute_bracket_at(sci, bracketMap, *position);
-                    recomputedPositions.insert(*position);
-                    if (brace >= 0) {
-                        data->redrawIndicies.insert(brace);
-                    }
-                    else if (brace == -2) {
-                        // Tried to brace match across nonsource which can
-                        // have different sylings. Need to redo computations
-                        recalculate = TRUE;
-                    }
-                    data->updateUI = TRUE;
-                }
+        ScintillaObject *sci = data->doc->editor->sci;
+        BracketScanner scanner(sci);
+        gint length = SSM(sci, SCI_GETLENGTH, BC_NO_ARG, BC_NO_ARG);
 
-                break;
+        std::string text;
+        text.reserve(length);
+        scanner.ForEachSlice(0, length,
+            [&](const gchar *slice, gint position, gint sliceLength) {
+                text.append(slice, sliceLength);
             }
-        }
-
-        position = data->recomputeIndicies.erase(position);
+        );
 
-        if (numIterations >= sIterationLimit) {
-            break;
-        }
-    }
+        std::vector<guint8> styles;
+        scanner.GetStyles(0, length, styles);
 
-    if (recalculate) {
-        // Redo everything we just did since it's likely wrong
-        data->recomputeIndicies.insert(
-            recomputedPositions.begin(),
-            recomputedPositions.end()
+        data->traceRecorder.RecordDocument(
+            text.data(), styles.data(), length,
+            data->GetCodeStyles(), data->bracketColorsEnable
         );
     }
-    else {
-        if (data->updateUI) {
-            for (gint bracketType = 0; bracketType < BracketType::COUNT; bracketType++) {
-                BracketMap &bracketMap = data->bracketMaps[bracketType];
-                std::set<BracketMap::Index> updatedBrackets = bracketMap.ComputeOrder();
-                data->redrawIndicies.insert(updatedBrackets.begin(), updatedBrackets.end());
-            }
-        }
-    }
-
 
-    return TRUE;
+    g_free(filename);
+    g_free(name);
+    g_free(basename);
+    g_free(dirname);
 }
 
 
@@ -1083,14 +2446,92 @@
 ----------------------------------------------------------------------------- */
 {
     g_return_if_fail(DOC_VALID(doc));
+    gpointer pluginData = plugin_get_document_data(geany_plugin, doc, sPluginName);
+    if (pluginData == NULL) {
+        // never activated, nothing was painted
+        return;
+    }
+
+    BracketColorsData *data = reinterpret_cast<BracketColorsData *>(pluginData);
+    data->StopTimers();
+
+    // cleanup passes a flag, see plugin_bracketcolors_cleanup()
+    gboolean atShutdown = user_data != NULL;
+    store_cached_brackets(data, atShutdown);
+
+    ScintillaObject *sci = doc->editor->sci;
+    remove_bc_indicators(sci);
+}
+
+
+
+// -----------------------------------------------------------------------------
+    static void on_document_filetype_set(
+        GObject *obj,
+        GeanyDocument *doc,
+        GeanyFiletype *filetypeOld,
+        gpointer user_data
+    )
+/*
+    lexer may have changed, code styles need to be looked up again
+----------------------------------------------------------------------------- */
+{
     gpointer pluginData = plugin_get_document_data(geany_plugin, doc, sPluginName);
     if (pluginData != NULL) {
         BracketColorsData *data = reinterpret_cast<BracketColorsData *>(pluginData);
-        data->StopTimers();
+        data->codeStylesValid = FALSE;
+
+        // geany re-applies the filetype when the color scheme changes
+        if (is_curr_document(data)) {
+            check_background_color(data);
+        }
     }
+}
+
+
 
+// -----------------------------------------------------------------------------
+    static BracketColorsData* setup_document(
+        GeanyDocument *doc
+    )
+/*
+    attach our data to a document and start following its edits
+----------------------------------------------------------------------------- */
+{
+    BracketColorsData *data = bracket_colors_data_new(doc);
     ScintillaObject *sci = doc->editor->sci;
-    remove_bc_indicators(sci);
+    data->doc = doc;
+
+    plugin_signal_connect(
+        geany_plugin,
+        G_OBJECT(sci), "sci-notify",
+        FALSE,
+        G_CALLBACK(on_sci_notify), data
+    );
+
+    /*
+     * Setup our bracket indicators
+     */
+
+    data->backgroundColor = SSM(sci, SCI_STYLEGETBACK, STYLE_DEFAULT, BC_NO_ARG);
+
+    if (gPluginConfiguration.mUseDefaults) {
+        if (utils_is_dark(data->backgroundColor)) {
+            gPluginConfiguration.mColors = sDarkBackgroundColors;
+        }
+        else {
+            gPluginConfiguration.mColors = sLightBackgroundColors;
+        }
+    }
+    else {
+        gPluginConfiguration.mColors = gPluginConfiguration.mCustomColors;
+    }
+
+    assign_indicator_colors(data);
+    load_cached_brackets(data);
+    start_trace(data);
+
+    return data;
 }
 
 
@@ -1105,12 +2546,28 @@
 
 ----------------------------------------------------------------------------- */
 {
+    g_return_if_fail(DOC_VALID(doc));
+
+    BracketColorsData *data;
+
     gpointer pluginData = plugin_get_document_data(geany_plugin, doc, sPluginName);
     if (pluginData != NULL) {
-        BracketColorsData *data = reinterpret_cast<BracketColorsData *>(pluginData);
-        assign_indicator_colors(data);
-        data->StartTimers();
+        data = reinterpret_cast<BracketColorsData *>(pluginData);
+    }
+    else {
+        // first time this document is shown
+        data = setup_document(doc);
     }
+
+    data->lastActivated = g_get_monotonic_time();
+    data->Wake();
+    start_trace(data);
+    hibernate_inactive_documents();
+    check_background_color(data);
+    assign_indicator_colors(data);
+    update_visible_range(data);
+    data->StartTimers();
+    enforce_memory_budget();
 }
 
 
@@ -1124,13 +2581,35 @@
 
 ----------------------------------------------------------------------------- */
 {
+    gint64 startTime = g_get_monotonic_time();
+    gboolean setUp = FALSE;
+
     GeanyDocument *currDoc = document_get_current();
     if (currDoc != NULL) {
+        BracketColorsData *data;
+
         gpointer pluginData = plugin_get_document_data(geany_plugin, currDoc, sPluginName);
         if (pluginData != NULL) {
-            BracketColorsData *data = reinterpret_cast<BracketColorsData *>(pluginData);
-            data->StartTimers();
+            data = reinterpret_cast<BracketColorsData *>(pluginData);
+        }
+        else {
+            data = setup_document(currDoc);
+            setUp = TRUE;
         }
+
+        data->StartTimers();
+    }
+
+    if (setUp) {
+        gStartupReport.Add(startTime, TRUE);
+    }
+    else {
+        gStartupReport.elapsed += g_get_monotonic_time() - startTime;
+    }
+
+    // when enabled from the plugin manager there is no startup to wait for
+    if (user_data == NULL or main_is_realized()) {
+        gStartupReport.Finish();
     }
 }
 
@@ -1156,6 +2635,24 @@
 
 
 
+// -----------------------------------------------------------------------------
+    static std::string get_cache_dirname(void)
+/*
+
+----------------------------------------------------------------------------- */
+{
+    gchar *dirname = g_build_filename(
+        geany_data->app->configdir, "plugins", sPluginName, "cache", NULL
+    );
+
+    std::string result(dirname);
+    g_free(dirname);
+
+    return result;
+}
+
+
+
 // -----------------------------------------------------------------------------
     static void on_document_open(
         GObject *obj,
@@ -1168,41 +2665,24 @@
 {
     g_return_if_fail(DOC_VALID(doc));
 
-    BracketColorsData *data = bracket_colors_data_new(doc);
-    ScintillaObject *sci = doc->editor->sci;
-    data->doc = doc;
-
-    plugin_signal_connect(
-        geany_plugin,
-        G_OBJECT(sci), "sci-notify",
-        FALSE,
-        G_CALLBACK(on_sci_notify), data
-    );
+    gint64 startTime = g_get_monotonic_time();
 
     /*
-     * Setup our bracket indicators
+     * Everything but the document on screen is set up the first time it is
+     * activated, so a large session does not slow down startup
      */
 
-    data->backgroundColor = SSM(sci, SCI_STYLEGETBACK, STYLE_DEFAULT, BC_NO_ARG);
+    gpointer pluginData = plugin_get_document_data(geany_plugin, doc, sPluginName);
+    gboolean setUp = pluginData == NULL and doc == document_get_current();
 
-    if (gPluginConfiguration.mUseDefaults) {
-        if (utils_is_dark(data->backgroundColor)) {
-            gPluginConfiguration.mColors = sDarkBackgroundColors;
-        }
-        else {
-            gPluginConfiguration.mColors = sLightBackgroundColors;
+    if (setUp) {
+        BracketColorsData *data = setup_document(doc);
+        if (user_data == NULL) {
+            data->StartTimers();
         }
     }
-    else {
-        gPluginConfiguration.mColors = gPluginConfiguration.mCustomColors;
-    }
-
-    assign_indicator_colors(data);
-
-    if (user_data == NULL) {
-        data->StartTimers();
-    }
 
+    gStartupReport.Add(startTime, setUp);
 }
 
 
@@ -1216,10 +2696,19 @@
 
 ----------------------------------------------------------------------------- */
 {
+    gint64 startTime = g_get_monotonic_time();
+
     geany_plugin = plugin;
     geany_data = plugin->geany_data;
 
+    // analysis threads may still be running after cleanup, keep their code
+    plugin_module_make_resident(plugin);
+
     gPluginConfiguration.LoadConfig(get_config_filename());
+    gBracketCache.mDirectory = get_cache_dirname();
+
+    // documents below count their own time
+    gStartupReport.elapsed += g_get_monotonic_time() - startTime;
 
     gboolean inInit = TRUE;
 
@@ -1252,12 +2741,15 @@
 
 ----------------------------------------------------------------------------- */
 {
+    gboolean atShutdown = TRUE;
+
     guint i = 0;
     foreach_document(i)
     {
-        on_document_close(NULL, documents[i], NULL);
+        on_document_close(NULL, documents[i], (gpointer) &atShutdown);
     }
 
+    gBracketCache.Prune(sMaxCacheFiles);
     gPluginConfiguration.SaveConfig(get_config_filename());
 }
 
@@ -1325,6 +2817,106 @@
 
 
 
+// -----------------------------------------------------------------------------
+    static void background_checkbox_toggled(
+        GtkWidget *checkbox,
+        gpointer data
+    )
+/*
+    choose between worker thread and main thread document analysis
+----------------------------------------------------------------------------- */
+{
+    gPluginConfiguration.mBackgroundAnalysis = gtk_toggle_button_get_active(
+        GTK_TOGGLE_BUTTON(checkbox)
+    );
+}
+
+
+
+// -----------------------------------------------------------------------------
+    static void trace_checkbox_toggled(
+        GtkWidget *checkbox,
+        gpointer data
+    )
+/*
+    start recording the current document, or stop recording all of them
+----------------------------------------------------------------------------- */
+{
+    gPluginConfiguration.mRecordTraces = gtk_toggle_button_get_active(
+        GTK_TOGGLE_BUTTON(checkbox)
+    );
+
+    guint i = 0;
+    foreach_document(i)
+    {
+        gpointer pluginData = plugin_get_document_data(geany_plugin, documents[i], sPluginName);
+        if (pluginData == NULL) {
+            continue;
+        }
+
+        BracketColorsData *bcd = reinterpret_cast<BracketColorsData *>(pluginData);
+        if (not gPluginConfiguration.mRecordTraces) {
+            bcd->traceRecorder.Close();
+        }
+        else if (is_curr_document(bcd)) {
+            start_trace(bcd);
+        }
+    }
+}
+
+
+
+#ifdef BC_ENABLE_METRICS
+// -----------------------------------------------------------------------------
+    static void dump_metrics_clicked(
+        GtkButton *button,
+        gpointer data
+    )
+/*
+    write the latency histograms and message counts next to the traces
+----------------------------------------------------------------------------- */
+{
+    gchar *dirname = g_build_filename(
+        geany_data->app->configdir, "plugins", sPluginName, "metrics", NULL
+    );
+
+    gint err = utils_mkdir(dirname, TRUE);
+    if (err != 0) {
+        g_warning("Failed to create metrics directory \"%s\": %s", dirname, g_strerror(err));
+        g_free(dirname);
+        return;
+    }
+
+    gchar *name = g_strdup_printf("metrics-%" G_GINT64_FORMAT ".txt", g_get_real_time());
+    gchar *filename = g_build_filename(dirname, name, NULL);
+
+    if (gMetrics.Dump(filename)) {
+        ui_set_statusbar(TRUE, _("Bracket Colors metrics written to %s"), filename);
+    }
+
+    g_free(filename);
+    g_free(name);
+    g_free(dirname);
+}
+#endif
+
+
+
+// -----------------------------------------------------------------------------
+    static void parallel_size_changed(
+        GtkSpinButton *spinButton,
+        gpointer data
+    )
+/*
+    documents at least this big are analyzed on every processor
+----------------------------------------------------------------------------- */
+{
+    gPluginConfiguration.mParallelMinSize =
+        gtk_spin_button_get_value_as_int(spinButton) * 1024 * 1024;
+}
+
+
+
 // -----------------------------------------------------------------------------
     static void color_button_set(
         GtkColorButton *colorButton,
@@ -1349,6 +2941,78 @@
 
 
 
+// -----------------------------------------------------------------------------
+    static void memory_budget_changed(
+        GtkSpinButton *spinButton,
+        gpointer data
+    )
+/*
+    analyses of background documents are dropped above this, 0 disables
+----------------------------------------------------------------------------- */
+{
+    gPluginConfiguration.mMemoryBudget = gtk_spin_button_get_value_as_int(spinButton);
+    enforce_memory_budget();
+}
+
+
+
+// -----------------------------------------------------------------------------
+    static void rebuild_threshold_changed(
+        GtkSpinButton *spinButton,
+        gpointer data
+    )
+/*
+    percentage of the document or its brackets queued at once above which
+    the document is analyzed again instead, 0 disables
+----------------------------------------------------------------------------- */
+{
+    gPluginConfiguration.mRebuildThreshold = gtk_spin_button_get_value_as_int(spinButton);
+}
+
+
+
+// -----------------------------------------------------------------------------
+    static gboolean update_status_label(
+        gpointer data
+    )
+/*
+    show how often our work sources fired during the last second, how much
+    memory our documents hold and what we added to startup
+----------------------------------------------------------------------------- */
+{
+    guint numDocuments = 0;
+    gchar *memory = g_format_size(get_memory_usage(&numDocuments));
+
+    gchar *text = g_strdup_printf(
+        _("Wakeups per second: %u\nMemory: %s in %u documents\n"
+          "Startup: %.1f ms, %u of %u documents set up"),
+        gWakeupCounter.PerSecond(), memory, numDocuments,
+        gStartupReport.elapsed / 1000.0,
+        gStartupReport.numSetUp, gStartupReport.numDocuments
+    );
+    gtk_label_set_text(GTK_LABEL(data), text);
+    g_free(text);
+    g_free(memory);
+
+    return TRUE;
+}
+
+
+
+// -----------------------------------------------------------------------------
+    static void status_label_destroyed(
+        GtkWidget *label,
+        gpointer data
+    )
+/*
+    stop refreshing once the dialog goes away
+----------------------------------------------------------------------------- */
+{
+    g_source_remove(GPOINTER_TO_UINT(data));
+}
+
+
+
 // -----------------------------------------------------------------------------
     static GtkWidget* plugin_bracketcolors_configure(
         GeanyPlugin *plugin,
@@ -1414,6 +3078,178 @@
         gPluginConfiguration.mUseDefaults
     );
 
+    GtkWidget *backgroundCheckBox = gtk_check_button_new_with_label(
+        _("Analyze documents in the background")
+    );
+    gtk_grid_attach(
+        GTK_GRID(grid), backgroundCheckBox,
+        0, 2, 1, 1
+    );
+
+    gtk_toggle_button_set_active(
+        GTK_TOGGLE_BUTTON(backgroundCheckBox),
+        gPluginConfiguration.mBackgroundAnalysis
+    );
+
+    g_signal_connect(
+        G_OBJECT(backgroundCheckBox),
+        "toggled",
+        G_CALLBACK(background_checkbox_toggled),
+        NULL
+    );
+
+    GtkWidget *parallelGrid = gtk_grid_new();
+    gtk_grid_set_column_spacing(GTK_GRID(parallelGrid), 5);
+
+    GtkWidget *parallelLabel = gtk_label_new(
+        _("Use all processors for documents above (MiB):")
+    );
+    gtk_grid_attach(
+        GTK_GRID(parallelGrid), parallelLabel,
+        0, 0, 1, 1
+    );
+
+    GtkWidget *parallelSpin = gtk_spin_button_new_with_range(0, 2047, 1);
+    gtk_spin_button_set_value(
+        GTK_SPIN_BUTTON(parallelSpin),
+        gPluginConfiguration.mParallelMinSize / (1024 * 1024)
+    );
+    gtk_grid_attach(
+        GTK_GRID(parallelGrid), parallelSpin,
+        1, 0, 1, 1
+    );
+
+    g_signal_connect(
+        G_OBJECT(parallelSpin),
+        "value-changed",
+        G_CALLBACK(parallel_size_changed),
+        NULL
+    );
+
+    gtk_grid_attach(
+        GTK_GRID(grid), parallelGrid,
+        0, 3, 1, 1
+    );
+
+    GtkWidget *budgetGrid = gtk_grid_new();
+    gtk_grid_set_column_spacing(GTK_GRID(budgetGrid), 5);
+
+    GtkWidget *budgetLabel = gtk_label_new(
+        _("Memory budget for all documents (MiB, 0 for none):")
+    );
+    gtk_grid_attach(
+        GTK_GRID(budgetGrid), budgetLabel,
+        0, 0, 1, 1
+    );
+
+    GtkWidget *budgetSpin = gtk_spin_button_new_with_range(0, 65536, 16);
+    gtk_spin_button_set_value(
+        GTK_SPIN_BUTTON(budgetSpin),
+        gPluginConfiguration.mMemoryBudget
+    );
+    gtk_grid_attach(
+        GTK_GRID(budgetGrid), budgetSpin,
+        1, 0, 1, 1
+    );
+
+    g_signal_connect(
+        G_OBJECT(budgetSpin),
+        "value-changed",
+        G_CALLBACK(memory_budget_changed),
+        NULL
+    );
+
+    gtk_grid_attach(
+        GTK_GRID(grid), budgetGrid,
+        0, 4, 1, 1
+    );
+
+    GtkWidget *rebuildGrid = gtk_grid_new();
+    gtk_grid_set_column_spacing(GTK_GRID(rebuildGrid), 5);
+
+    GtkWidget *rebuildLabel = gtk_label_new(
+        _("Reanalyze documents when edits queue more than (%, 0 for never):")
+    );
+    gtk_grid_attach(
+        GTK_GRID(rebuildGrid), rebuildLabel,
+        0, 0, 1, 1
+    );
+
+    GtkWidget *rebuildSpin = gtk_spin_button_new_with_range(0, 100, 5);
+    gtk_spin_button_set_value(
+        GTK_SPIN_BUTTON(rebuildSpin),
+        gPluginConfiguration.mRebuildThreshold
+    );
+    gtk_grid_attach(
+        GTK_GRID(rebuildGrid), rebuildSpin,
+        1, 0, 1, 1
+    );
+
+    g_signal_connect(
+        G_OBJECT(rebuildSpin),
+        "value-changed",
+        G_CALLBACK(rebuild_threshold_changed),
+        NULL
+    );
+
+    gtk_grid_attach(
+        GTK_GRID(grid), rebuildGrid,
+        0, 5, 1, 1
+    );
+
+    GtkWidget *traceCheckBox = gtk_check_button_new_with_label(
+        _("Record editing traces for bug reports")
+    );
+    gtk_grid_attach(
+        GTK_GRID(grid), traceCheckBox,
+        0, 6, 1, 1
+    );
+
+    gtk_toggle_button_set_active(
+        GTK_TOGGLE_BUTTON(traceCheckBox),
+        gPluginConfiguration.mRecordTraces
+    );
+
+    g_signal_connect(
+        G_OBJECT(traceCheckBox),
+        "toggled",
+        G_CALLBACK(trace_checkbox_toggled),
+        NULL
+    );
+
+#ifdef BC_ENABLE_METRICS
+    GtkWidget *metricsButton = gtk_button_new_with_label(_("Dump metrics"));
+    gtk_widget_set_halign(metricsButton, GTK_ALIGN_START);
+    gtk_grid_attach(
+        GTK_GRID(grid), metricsButton,
+        0, 8, 1, 1
+    );
+
+    g_signal_connect(
+        G_OBJECT(metricsButton),
+        "clicked",
+        G_CALLBACK(dump_metrics_clicked),
+        NULL
+    );
+#endif
+
+    GtkWidget *statusLabel = gtk_label_new(NULL);
+    gtk_label_set_xalign(GTK_LABEL(statusLabel), 0);
+    gtk_grid_attach(
+        GTK_GRID(grid), statusLabel,
+        0, 7, 1, 1
+    );
+
+    update_status_label(statusLabel);
+    guint labelTimeoutID = g_timeout_add_seconds(1, update_status_label, statusLabel);
+
+    g_signal_connect(
+        G_OBJECT(statusLabel),
+        "destroy",
+        G_CALLBACK(status_label_destroyed),
+        GUINT_TO_POINTER(labelTimeoutID)
+    );
+
     return grid;
 }
 
@@ -1425,10 +3261,11 @@
 
 ----------------------------------------------------------------------------- */
 {
-    { "document-open",          (GCallback) &on_document_open,      FALSE, NULL },
-    { "document-new",           (GCallback) &on_document_open,      FALSE, NULL },
-    { "document-close",         (GCallback) &on_document_close,     FALSE, NULL },
-    { "geany-startup-complete", (GCallback) &on_startup_complete,   FALSE, NULL },
+    { "document-open",          (GCallback) &on_document_open,            FALSE, NULL },
+    { "document-new",           (GCallback) &on_document_open,            FALSE, NULL },
+    { "document-close",         (GCallback) &on_document_close,           FALSE, NULL },
+    { "document-filetype-set",  (GCallback) &on_document_filetype_set,    FALSE, NULL },
+    { "geany-startup-complete", (GCallback) &on_startup_complete,         FALSE, NULL },
     { NULL, NULL, FALSE, NULL }
 };
 